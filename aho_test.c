@@ -0,0 +1,147 @@
+#include <stdio.h>
+#include <time.h>
+#include "stc_rand.h"
+#include "stc_aho.h"
+
+#define HAY_LEN 4096
+
+// every match, by end offset then longest first, like the automaton reports them
+void naive_find_all(StrList patterns, str s, AhoMatchList* out) {
+  isize max_len = 0;
+  for (isize p=0; p<patterns.len; ++p) {
+    if (patterns.data[p].len > max_len) max_len = patterns.data[p].len;
+  }
+  for (isize end=1; end<=s.len; ++end) {
+    for (isize len=end < max_len ? end : max_len; len>0; --len) {
+      for (isize p=0; p<patterns.len; ++p) {
+        str pat = patterns.data[p];
+        if (pat.len == len && memcmp(s.data + end - len, pat.data, len) == 0) {
+          AhoMatchList_push(out, (AhoMatch) { p, end - len });
+        }
+      }
+    }
+  }
+}
+
+// patterns ending at the same offset with the same length are reported in any order
+bool same_matches(AhoMatchList a, AhoMatchList b) {
+  if (a.len != b.len) return false;
+  for (isize i=0; i<a.len; ++i) {
+    bool found = false;
+    for (isize j=i; j<b.len && b.data[j].offset == a.data[i].offset; ++j) {
+      if (b.data[j].pattern == a.data[i].pattern) found = true;
+    }
+    for (isize j=i; j>=0 && b.data[j].offset == a.data[i].offset; --j) {
+      if (b.data[j].pattern == a.data[i].pattern) found = true;
+    }
+    if (!found) return false;
+  }
+  return true;
+}
+
+void random_text(char* buf, isize len, const char* alphabet, isize alphabet_len) {
+  for (isize i=0; i<len; ++i) buf[i] = alphabet[rand_bounded(alphabet_len)];
+}
+
+int main() {
+  rand_seed(42);
+
+  StrList words = {0};
+  StrList_push(&words, SV("he"));
+  StrList_push(&words, SV("she"));
+  StrList_push(&words, SV("his"));
+  StrList_push(&words, SV("hers"));
+  AhoCorasick ac = aho_new(words);
+  printf("States: %ld, byte classes: %ld\n", ac.states_len, ac.classes_len);
+
+  AhoMatchList matches = {0};
+  aho_find_all(&ac, SV("ushers and his hershey"), &matches);
+  for (isize i=0; i<matches.len; ++i) {
+    str pat = words.data[matches.data[i].pattern];
+    printf("%.*s at %ld\n", (int) pat.len, pat.data, matches.data[i].offset);
+  }
+  AhoMatch first;
+  printf("Is match: %d %d\n", aho_is_match(&ac, SV("nothing to see")), aho_find_first(&ac, SV("a hiss"), &first));
+  printf("First: pattern %ld at %ld\n", first.pattern, first.offset);
+  aho_free(&ac);
+
+  // random patterns against the naive search, with few (prefiltered) and many patterns
+  static char hay[HAY_LEN];
+  static char pats[4096][8];
+  const char* alphabets[] = { "ab", "abcd", "abcdefghijklmnopqrstuvwxyz" };
+  int mismatches = 0;
+  isize total = 0;
+  for (int round=0; round<60; ++round) {
+    const char* alphabet = alphabets[round % 3];
+    isize alphabet_len = strlen(alphabet);
+    isize patterns_len = round < 30 ? 1 + rand_bounded(AHO_TEDDY_MAX_PATTERNS) : 100 + rand_bounded(200);
+
+    StrList patterns = {0};
+    for (isize p=0; p<patterns_len; ++p) {
+      isize len = 1 + rand_bounded(sizeof(pats[0]));
+      random_text(pats[p], len, alphabet, alphabet_len);
+      StrList_push(&patterns, str_from_cstr_unchecked(pats[p], len));
+    }
+    isize hay_len = rand_bounded(HAY_LEN);
+    random_text(hay, hay_len, alphabet, alphabet_len);
+
+    AhoCorasick ac = aho_new(patterns);
+    AhoMatchList got = {0}, expected = {0};
+    str s = str_from_cstr_unchecked(hay, hay_len);
+    aho_find_all(&ac, s, &got);
+    naive_find_all(patterns, s, &expected);
+    if (!same_matches(got, expected)) mismatches += 1;
+    total += got.len;
+
+    AhoMatchList_free(&got);
+    AhoMatchList_free(&expected);
+    StrList_free(&patterns);
+    aho_free(&ac);
+  }
+  printf("Random sets: %d mismatches, %ld matches\n", mismatches, total);
+
+  // rare keywords in a long text: the prefilter skips most of it
+  static char text[1 << 24];
+  random_text(text, sizeof(text), "abcdefghijklmnopqrstuvwxyz ", 27);
+  memcpy(text + 12345, "ERROR", 5);
+  memcpy(text + sizeof(text) - 10, "panic", 5);
+  StrList keywords = {0};
+  StrList_push(&keywords, SV("ERROR"));
+  StrList_push(&keywords, SV("panic"));
+  StrList_push(&keywords, SV("FATAL"));
+  AhoCorasick small = aho_new(keywords);
+
+  AhoMatchList found = {0};
+  clock_t start = clock();
+  aho_find_all(&small, str_from_cstr_unchecked(text, sizeof(text)), &found);
+  double secs = (double) (clock() - start) / CLOCKS_PER_SEC;
+  printf("Keywords: %ld matches", found.len);
+  for (isize i=0; i<found.len; ++i) printf(" (%ld, %ld)", found.data[i].pattern, found.data[i].offset);
+  printf("\n");
+  fprintf(stderr, "3 keywords on 16MiB: %.3fs\n", secs);
+  AhoMatchList_free(&found);
+  aho_free(&small);
+
+  // thousands of keywords: no prefilter, but still a single pass
+  static char dict[3000][6];
+  StrList many = {0};
+  for (isize p=0; p<3000; ++p) {
+    random_text(dict[p], 6, "abcdefghijklmnopqrstuvwxyz", 26);
+    StrList_push(&many, str_from_cstr_unchecked(dict[p], 6));
+  }
+  AhoCorasick big = aho_new(many);
+  start = clock();
+  AhoMatchList big_found = {0};
+  aho_find_all(&big, str_from_cstr_unchecked(text, sizeof(text)), &big_found);
+  secs = (double) (clock() - start) / CLOCKS_PER_SEC;
+  printf("3000 keywords: %ld states, has prefilter %d\n", big.states_len, big.has_teddy);
+  fprintf(stderr, "3000 keywords on 16MiB: %.3fs, %ld matches\n", secs, big_found.len);
+  AhoMatchList_free(&big_found);
+  aho_free(&big);
+
+  StrList_free(&keywords);
+  StrList_free(&many);
+  StrList_free(&words);
+  AhoMatchList_free(&matches);
+  printf("Done\n");
+}
@@ -32,4 +32,5 @@ int main(int argc, char** argv) {
   }
 
   // binary_exec("fag.exe");
+  c_sources_free(&entries);
 }
\ No newline at end of file
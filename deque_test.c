@@ -8,60 +8,131 @@ int main() {
   Deque d = {0};
 
   // rangefor(int, i, 0, 100) {
-  //   deque_push_back(&d, i);
+  //   Deque_push_back(&d, i);
   // }
 
   // rangefor(int, i, 0, 100) {
-  //   deque_pop_back(&d);
+  //   Deque_pop_back(&d);
   // }
 
   // rangefor(int, i, 0, 50) {
-  //   deque_push_back(&d, i);
+  //   Deque_push_back(&d, i);
   // }
 
   // rangefor(int, i, 100, 200) {
-  //   deque_push_front(&d, i);
+  //   Deque_push_front(&d, i);
   // }
 
   rangefor(int, i, 0, 100) {
-    deque_push_front(&d, i);
+    Deque_push_front(&d, i);
   }
 
   rangefor(int, i, 0, 300) {
-    deque_push_back(&d, -i);
+    Deque_push_back(&d, -i);
   }
 
   rangefor(int, i, 0, 50) {
-    deque_push_front(&d, i+100);
+    Deque_push_front(&d, i+100);
   }
 
   rangefor(int, i, 0, 100) {
-    printf("Popping: %d\n", deque_pop_front(&d));
+    printf("Popping: %d\n", Deque_pop_front(&d));
   }
 
   rangefor(int, i, 0, d.cap) {
     printf("i = %d\t%d\n", i, d.data[i]);
   }
 
-  printf("Cap = %d, Len = %d, Head = %d, Tail = %d\n", d.cap, d.len, d.front, d.back);
+  printf("Cap = %d, Len = %d, Head = %d\n", d.cap, d.len, d.front);
+
+  int batch[] = {1000, 1001, 1002, 1003};
+  Deque_append_front(&d, batch, ArrayLen(batch));
+  Deque_append_back(&d, batch, ArrayLen(batch));
+  DequeSlices slices = Deque_as_slices(&d);
+  printf("Slices: %ld + %ld\n", slices.first_len, slices.second_len);
+
+  int* contiguous = Deque_make_contiguous(&d);
+  printf("Contiguous: %d %d ... %d %d\n", contiguous[0], contiguous[1], contiguous[d.len-2], contiguous[d.len-1]);
+  printf("Front = %d, Back = %d\n", *Deque_front(&d), *Deque_back(&d));
+  Deque_free(&d);
 
   srand(time(NULL));
-  BinaryHeap b = {0};
+  IntHeap b = {0};
   rangefor(int, i, 0, 50) {
-    bheap_push(&b, rand() % 100);
+    IntHeap_push(&b, rand() % 100);
     listfor(int, i, &b) {
       printf("%d\n", b.data[i]);
     }
 
-    printf("Max: %d\n\n", b.data[0]);
+    printf("Max: %d\n\n", IntHeap_top(&b));
   }
 
   rangefor(int, i, 0, 20) {
-    bheap_pop(&b);
+    IntHeap_pop(&b);
     listfor(int, i, &b) {
       printf("%d\n", b.data[i]);
     }
 
-    printf("Max: %d\n\n", b.data[0]);
+    printf("Max: %d\n\n", IntHeap_top(&b));
+  }
+
+  printf("Push pop 1000: %d, Max: %d\n", IntHeap_push_pop(&b, 1000), IntHeap_top(&b));
+  printf("Replace top with -1: %d, Max: %d\n", IntHeap_replace_top(&b, -1), IntHeap_top(&b));
+  IntHeap_free(&b);
+
+  int arr[1000];
+  rangefor(isize, i, 0, ArrayLen(arr)) arr[i] = rand() % 10000;
+  b = IntHeap_from_array(arr, ArrayLen(arr));
+  IntHeap_push_array(&b, arr, 100);
+  int prev = IntHeap_top(&b);
+  bool sorted = true;
+  while (b.len > 0) {
+    int curr = IntHeap_pop(&b);
+    if (curr > prev) sorted = false;
+    prev = curr;
+  }
+  printf("Heap pops sorted: %d\n", sorted);
+  IntHeap_free(&b);
+
+  // dijkstra, with one heap entry per node
+  #define NODES 6
+  i64 graph[NODES][NODES] = {
+    {0, 7, 9, 0, 0, 14},
+    {7, 0, 10, 15, 0, 0},
+    {9, 10, 0, 11, 0, 2},
+    {0, 15, 11, 0, 6, 0},
+    {0, 0, 0, 6, 0, 9},
+    {14, 0, 2, 0, 9, 0},
+  };
+  i64 dist[NODES];
+  rangefor(int, i, 0, NODES) dist[i] = -1;
+
+  IndexHeap frontier = {0};
+  IndexHeap_push(&frontier, 0, 0);
+  while (frontier.len > 0) {
+    IndexHeapEntry e = IndexHeap_pop(&frontier);
+    dist[e.handle] = e.key;
+    rangefor(int, next, 0, NODES) {
+      i64 w = graph[e.handle][next];
+      if (w == 0 || dist[next] >= 0) continue;
+      if (!IndexHeap_contains(&frontier, next)) IndexHeap_push(&frontier, next, e.key + w);
+      else if (e.key + w < IndexHeap_get(&frontier, next)) IndexHeap_decrease_key(&frontier, next, e.key + w);
+    }
+  }
+  rangefor(int, i, 0, NODES) printf("Dist 0 -> %d: %ld\n", i, dist[i]);
+
+  rangefor(int, i, 0, 100) IndexHeap_push(&frontier, i, rand() % 1000);
+  rangefor(int, i, 0, 100) if (i % 3 == 0) IndexHeap_remove(&frontier, i);
+  rangefor(int, i, 0, 100) if (i % 3 == 1) IndexHeap_increase_key(&frontier, i, IndexHeap_get(&frontier, i) + 500);
+  i64 prev_key = IndexHeap_top(&frontier).key;
+  sorted = true;
+  isize popped = 0;
+  while (frontier.len > 0) {
+    IndexHeapEntry e = IndexHeap_pop(&frontier);
+    if (e.key < prev_key || e.handle % 3 == 0) sorted = false;
+    prev_key = e.key;
+    popped += 1;
   }
-}
\ No newline at end of file
+  printf("Index heap pops sorted: %d, popped %ld\n", sorted, popped);
+  IndexHeap_free(&frontier);
+}
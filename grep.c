@@ -16,19 +16,17 @@ int main(int argc, char** argv) {
   if (!res) return 0;
 
   str query_str = str_from_cstr(query);
+  StrSearcher searcher = str_searcher_new_ignorecase(query_str);
   str contents_str = String_to_tmp_str(contents);
 
-  StrLines it = str_lines(contents_str);
-  String lower = {0};
-  while(str_has_line(&it)) {
-    str line = str_next_line(&it);
-    str_to_lower(&lower, line);
-    int i = str_match(String_to_tmp_str(lower), query_str);
+  StrNumberedLines it = str_numbered_lines(contents_str, true);
+  while(str_has_numbered_line(&it)) {
+    StrLine line = str_next_numbered_line(&it);
+    isize i = str_searcher_find(&searcher, line.line);
     if (i != -1) {
-      printf(str_fmt "\n", str_arg(line));
+      printf("%ld: " str_fmt "\n", line.number, str_arg(line.line));
     }
   }
 
-  String_free(&lower);
   String_free(&contents);
 }
\ No newline at end of file
@@ -14,6 +14,25 @@ struct Dummy dummy_new() {
 list_def_all(struct Dummy, DummyList)
 list_def_all(char*, StringList)
 
+#define DUMMY_FIELDS(X) \
+  X(int, a) \
+  X(int, b) \
+  X(double, weight)
+soa_list_def(DummySoa, DUMMY_FIELDS)
+
+seglist_def(int, IntSegList)
+slotmap_def(int, IntSlotMap)
+
+void cstr_drop(char** s) {
+  free(*s);
+}
+list_def_owned(char*, OwnedCstrList, cstr_drop)
+list_def_alg(char*, OwnedCstrList)
+
+bool cstr_is_short(const char** s) {
+  return strlen(*s) < 4;
+}
+
 bool int_is_even(const int* val) {
   return *val % 2 == 0;
 }
@@ -73,6 +92,65 @@ int main() {
     printf("%d = %d %d\n", i, dummies.data[i].a, dummies.data[i].b);
   }
 
+  DummySoa soa = {0};
+  rangefor(int, i, 0, 50) {
+    DummySoa_push(&soa, (DummySoaElem) { i, i * 2, i / 2.0 });
+  }
+  DummySoa_swap(&soa, 0, 49);
+  DummySoa_remove_swap(&soa, 10);
+  double total_weight = 0;
+  listfor(isize, i, &soa) total_weight += soa.weight[i];
+  DummySoaElem last = DummySoa_pop(&soa);
+  printf("Soa len = %ld, total weight = %f, last = %d %d\n", soa.len, total_weight, last.a, last.b);
+  DummySoa_free(&soa);
+
+  IntSegList seg = {0};
+  int* seg_first = IntSegList_push(&seg, -1);
+  rangefor(int, i, 0, 1000) IntSegList_push(&seg, i);
+  isize seg_sum = 0;
+  rangefor(isize, k, 0, seg.chunks_len) {
+    isize chunk_len;
+    int* chunk = IntSegList_chunk(&seg, k, &chunk_len);
+    rangefor(isize, i, 0, chunk_len) seg_sum += chunk[i];
+  }
+  printf("Seglist first = %d, at(500) = %d, sum = %ld, chunks = %ld\n", *seg_first, *IntSegList_at(&seg, 500), seg_sum, seg.chunks_len);
+  IntSegList_free(&seg);
+  // chunks past 2^31 elements
+  printf("Seglist chunk 27: start = %ld, cap = %ld, idx of start = %ld\n", seglist_chunk_start(27), seglist_chunk_cap(27), seglist_chunk_idx(seglist_chunk_start(27)));
+  printf("Seglist chunk 40: start = %ld, cap = %ld, idx of start = %ld\n", seglist_chunk_start(40), seglist_chunk_cap(40), seglist_chunk_idx(seglist_chunk_start(40)));
+
+  IntSlotMap sm = {0};
+  SlotKey keys[100];
+  rangefor(int, i, 0, 100) keys[i] = IntSlotMap_insert(&sm, i);
+  rangefor(int, i, 0, 100) if (i % 2 == 0) IntSlotMap_remove(&sm, keys[i], NULL);
+  SlotKey reused_key = IntSlotMap_insert(&sm, 1000);
+  i64 sm_sum = 0;
+  listforeach(int, v, &sm) sm_sum += *v;
+  printf("Slotmap len = %ld, sum = %ld, get(keys[51]) = %d, stale key found: %d, reused slot: %d\n",
+    sm.len, sm_sum, *IntSlotMap_get(&sm, keys[51]), IntSlotMap_contains(&sm, keys[98]), reused_key.idx == keys[98].idx);
+  int removed = 0;
+  bool first_remove = IntSlotMap_remove(&sm, keys[51], &removed);
+  bool second_remove = IntSlotMap_remove(&sm, keys[51], NULL);
+  printf("Remove twice: %d %d, removed value: %d\n", first_remove, second_remove, removed);
+  bool keys_match = true;
+  listfor(isize, i, &sm) keys_match &= *IntSlotMap_get(&sm, IntSlotMap_key_at(&sm, i)) == sm.data[i];
+  printf("Dense keys match: %d\n", keys_match);
+  IntSlotMap_clear(&sm);
+  printf("Cleared, old key found: %d\n", IntSlotMap_contains(&sm, reused_key));
+  IntSlotMap_free(&sm);
+
+  OwnedCstrList owned = {0};
+  rangefor(int, i, 0, 20) {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "n%d", i * 50);
+    OwnedCstrList_push(&owned, strdup(buf));
+  }
+  // dropped elements are freed by retain, truncate and free
+  OwnedCstrList_retain(&owned, cstr_is_short);
+  OwnedCstrList_truncate(&owned, 2);
+  listforeach(char*, s, &owned) printf("%s\n", *s);
+  OwnedCstrList_free(&owned);
+
   StringList s = {0};
   StringList_push(&s, "Hello!");
   StringList_push(&s, "World!");
@@ -87,6 +165,7 @@ int main() {
     IntList_push(&r, i);
   }
 
+  rand_seed(42);
   IntList_shuffle(&r);
   listfor(int, i, &r) {
     printf("%d\n", r.data[i]);
@@ -97,6 +176,30 @@ int main() {
     printf("%d\n", r.data[i]);
   }
 
+  IntList dups = {0};
+  rangefor(int, i, 0, 100) {
+    IntList_push(&dups, (i * 7) % 13);
+  }
+  printf("Distinct values: %ld\n", IntList_unique_count(&dups, NULL, NULL));
+  IntList_dedup_hash(&dups, NULL, int_cmp);
+  listforeach(int, n, &dups) {
+    printf("%d ", *n);
+  }
+  printf("\nlen = %ld\n", dups.len);
+  IntList_free(&dups);
+
+  IntList_shuffle(&r);
+  IntList_top_k(&r, 5, int_cmp);
+  printf("5 smallest:");
+  rangefor(int, i, 0, 5) printf(" %d", r.data[i]);
+  IntList_shuffle(&r);
+  IntList_select_nth(&r, 50, int_cmp);
+  printf("\nMedian: %d\n", r.data[50]);
+  IntList_sample(&r, 10);
+  printf("Sample:");
+  rangefor(int, i, 0, 10) printf(" %d", r.data[i]);
+  printf("\n");
+
   int buf[] = {3, 2, 1, 0};
   IntList perm = IntList_from_array(buf, sizeof(buf)/ sizeof(int));
   String sb = {0};
@@ -0,0 +1,202 @@
+#include <stdio.h>
+#include <pthread.h>
+#include "stc_mem.h"
+#include "stc_list.h"
+#include "stc_str.h"
+
+isize arena_regions(Arena* a) {
+  isize n = 0;
+  for (struct Region* r = a->head; r != NULL; r = r->next) n += 1;
+  return n;
+}
+
+isize arena_used(Arena* a) {
+  isize n = 0;
+  for (struct Region* r = a->head; r != NULL; r = r->next) n += r->len;
+  return n;
+}
+
+// builds its result in out, using a scratch arena for temporaries
+int* squares(Arena* out, isize n) {
+  ArenaTemp tmp = scratch_begin(out);
+  isize* tmp_buf = arena_alloc(tmp.arena, n, isize);
+  for (isize i=0; i<n; ++i) tmp_buf[i] = i * i;
+
+  int* res = arena_alloc(out, n, int);
+  for (isize i=0; i<n; ++i) res[i] = tmp_buf[i];
+  scratch_end(tmp);
+  return res;
+}
+
+typedef struct Node {
+  struct Node* next;
+  i64 val;
+} Node;
+
+#define POOL_THREADS 4
+#define POOL_ROUNDS 100000
+
+void* pool_worker(void* arg) {
+  SharedPool* p = arg;
+  PoolCache cache = {0};
+  Node* live = NULL;
+  isize live_len = 0;
+  for (isize i=0; i<POOL_ROUNDS; ++i) {
+    Node* n = pool_cache_alloc(p, &cache);
+    n->val = i;
+    n->next = live;
+    live = n;
+    live_len += 1;
+    // release in bursts, so batches go back and forth with the depot
+    if (live_len == 300) {
+      while (live != NULL) {
+        Node* next = live->next;
+        pool_cache_release(p, &cache, live);
+        live = next;
+      }
+      live_len = 0;
+    }
+  }
+  while (live != NULL) {
+    Node* next = live->next;
+    pool_cache_release(p, &cache, live);
+    live = next;
+  }
+  pool_cache_flush(p, &cache);
+  return NULL;
+}
+
+int main() {
+  Arena a = {0};
+
+  bool aligned = true;
+  for (isize i=0; i<1000; ++i) {
+    char* c = arena_alloc(&a, 1, char);
+    double* d = arena_alloc(&a, 3, double);
+    void* page = arena_alloc_with_size_align(&a, 1, 100, 256);
+    aligned &= ((uptr) d % _Alignof(double)) == 0 && ((uptr) page % 256) == 0;
+    *c = 'a'; d[2] = 1.0;
+  }
+  printf("Aligned: %d, regions: %ld, used: %ld\n", aligned, arena_regions(&a), arena_used(&a));
+
+  void* big = arena_alloc(&a, 1 << 20, byte);
+  memset(big, 0, 1 << 20);
+  printf("After a big allocation, regions: %ld\n", arena_regions(&a));
+
+  // the last allocation grows in place
+  int* arr = arena_alloc(&a, 4, int);
+  int* grown = arena_realloc(&a, arr, 4 * sizeof(int), 64 * sizeof(int), _Alignof(int));
+  printf("Grown in place: %d\n", arr == grown);
+  arena_alloc(&a, 1, int);
+  int* moved = arena_realloc(&a, grown, 64 * sizeof(int), 128 * sizeof(int), _Alignof(int));
+  printf("Not last, moved: %d\n", moved != grown);
+
+  // checkpoints
+  ArenaMark mark = arena_save(&a);
+  isize used = arena_used(&a);
+  for (isize i=0; i<100; ++i) arena_alloc(&a, 1000, int);
+  isize regions = arena_regions(&a);
+  arena_restore(&a, mark);
+  printf("Restored: %d\n", arena_used(&a) == used);
+  for (isize i=0; i<100; ++i) arena_alloc(&a, 1000, int);
+  printf("Regions reused after restore: %d\n", arena_regions(&a) == regions);
+
+  arena_clear(&a);
+  printf("Cleared, used: %ld, regions: %ld\n", arena_used(&a), arena_regions(&a));
+
+  // containers growing in an arena realloc in place
+  Allocator alloc = arena_allocator(&a);
+  IntList l = IntList_with_alloc(&alloc, 4);
+  for (int i=0; i<10000; ++i) IntList_push(&l, i);
+  printf("List in arena: len %ld, arena used: %ld bytes\n", l.len, arena_used(&a));
+  IntList_free(&l);
+
+  int* sq = squares(&a, 1000);
+  printf("Squares: %d %d %d\n", sq[0], sq[10], sq[999]);
+  ArenaTemp tmp = scratch_begin(NULL);
+  printf("Scratch empty after use: %d\n", arena_used(tmp.arena) == 0);
+  scratch_end(tmp);
+
+  scratch_free();
+  arena_free(&a);
+
+  VArena va;
+  varena_init(&va, (isize) 1 << 34, false);
+  printf("VArena reserved: %ld, committed: %ld\n", va.reserved, va.committed);
+  Allocator valloc = varena_allocator(&va);
+  IntList big_list = IntList_with_alloc(&valloc, 4);
+  int* first_data = big_list.data;
+  for (int i=0; i<1000000; ++i) IntList_push(&big_list, i);
+  printf("VArena list never moved: %d, used: %ld, committed: %ld\n", big_list.data == first_data, va.len, va.committed);
+
+  isize vmark = varena_save(&va);
+  varena_alloc(&va, 1000, double);
+  varena_restore(&va, vmark);
+  printf("VArena restored: %d\n", va.len == vmark);
+  varena_clear(&va, true);
+  int* zeroed = varena_alloc(&va, 10, int);
+  printf("VArena released, zeroed: %d\n", zeroed[0] == 0 && zeroed[9] == 0);
+  varena_free(&va);
+
+  Pool pool;
+  pool_init_for(&pool, Node);
+  Node* nodes[1000];
+  for (int i=0; i<1000; ++i) nodes[i] = pool_alloc(&pool);
+  for (int i=0; i<1000; i += 2) pool_release(&pool, nodes[i]);
+  Node* reused = pool_alloc(&pool);
+  printf("Pool obj size: %ld, slab size: %ld, live: %ld, reused freed object: %d\n",
+    pool.obj_size, pool.slab_size, pool.live, reused == nodes[998]);
+  pool_free(&pool);
+
+  SharedPool shared;
+  shared_pool_init(&shared, sizeof(Node), _Alignof(Node));
+  pthread_t threads[POOL_THREADS];
+  for (int i=0; i<POOL_THREADS; ++i) pthread_create(&threads[i], NULL, pool_worker, &shared);
+  for (int i=0; i<POOL_THREADS; ++i) pthread_join(threads[i], NULL);
+  isize depot_objs = 0;
+  for (isize i=0; i<shared.depot_len; ++i) depot_objs += shared.depot[i].len;
+  printf("Shared pool: all objects back in the depot: %d\n", depot_objs == shared.pool.live);
+  shared_pool_free(&shared);
+
+  varena_init(&va, 64 << 20, true);
+  double* d = varena_alloc(&va, 1 << 20, double);
+  d[(1 << 20) - 1] = 1.0;
+  printf("Huge page VArena aligned: %d, committed: %ld\n", ((uptr) va.base % VARENA_HUGE_PAGE) == 0, va.committed);
+  varena_free(&va);
+
+#ifdef STC_TRACK_ALLOC
+  IntList leaked = {0};
+  rangefor(int, i, 0, 1000) IntList_push(&leaked, i);
+
+  // two copies of the same tag are one site
+  char tag_a[] = "mem_test.c:tag", tag_b[] = "mem_test.c:tag";
+  int x, y;
+  isize sites_before = alloc_tracker.sites_len;
+  alloc_track_alloc(tag_a, &x, sizeof(x), false);
+  alloc_track_alloc(tag_b, &y, sizeof(y), false);
+  printf("Same tag contents, one site: %d\n", alloc_tracker.sites_len == sites_before + 1);
+  alloc_track_free(&x);
+  alloc_track_free(&y);
+
+  // x reused without a free in between: the stale record is replaced, not duplicated
+  isize records_before = alloc_tracker.records_len;
+  alloc_track_alloc("mem_test.c:reused", &x, sizeof(x), false);
+  alloc_track_alloc("mem_test.c:reused", &x, sizeof(x), false);
+  alloc_track_free(&x);
+  i32 reused_idx;
+  AllocSite* reused_site = alloc_track_site("mem_test.c:reused", &reused_idx);
+  printf("Reused pointer, one record: %d, live: %ld\n", alloc_tracker.records_len == records_before, reused_site->live_bytes);
+
+  // a clone is counted here, not in stc_str.h
+  str cloned = str_clone(SV("clone"));
+  static AllocSite sites[STC_TRACK_MAX_SITES];
+  isize sites_len = alloc_track_sites(sites);
+  bool clone_here = false;
+  for (isize i=0; i<sites_len; ++i) {
+    if (strncmp(sites[i].tag, "mem_test.c:", 11) == 0 && sites[i].live_bytes == cloned.len) clone_here = true;
+  }
+  printf("Clone counted on its caller: %d\n", clone_here);
+
+  alloc_track_report(stdout);
+#endif
+}
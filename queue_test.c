@@ -0,0 +1,97 @@
+#include <stdio.h>
+#include <pthread.h>
+#include "stc_list.h"
+#include "stc_queue.h"
+
+spsc_def(isize, IntSpsc)
+
+#define COUNT 1000000
+
+void* spsc_producer(void* arg) {
+  IntSpsc* q = arg;
+  isize i = 0;
+  while (i < COUNT / 2) {
+    if (IntSpsc_push(q, i)) i += 1;
+  }
+
+  isize batch[64];
+  while (i < COUNT) {
+    isize n = 0;
+    for (; n < 64 && i + n < COUNT; ++n) batch[n] = i + n;
+    isize pushed = 0;
+    while (pushed < n) pushed += IntSpsc_push_array(q, batch + pushed, n - pushed);
+    i += n;
+  }
+  return NULL;
+}
+
+mpmc_def(isize, IntMpmc)
+
+#define MPMC_THREADS 4
+
+typedef struct {
+  IntMpmc* q;
+  isize id;
+  isize sum;
+} MpmcWorker;
+
+void* mpmc_producer(void* arg) {
+  MpmcWorker* w = arg;
+  isize batch[16];
+  for (isize i = w->id; i < COUNT; i += MPMC_THREADS * 16) {
+    isize n = 0;
+    for (isize j = i; n < 16 && j < COUNT; ++n, j += MPMC_THREADS) batch[n] = j;
+    // the blocking push may push only part of the batch
+    for (isize pushed = 0; pushed < n;) pushed += IntMpmc_push_array(w->q, batch + pushed, n - pushed);
+  }
+  return NULL;
+}
+
+void* mpmc_consumer(void* arg) {
+  MpmcWorker* w = arg;
+  for (isize i = 0; i < COUNT / MPMC_THREADS; ++i) {
+    w->sum += IntMpmc_pop(w->q);
+  }
+  return NULL;
+}
+
+int main() {
+  IntSpsc spsc;
+  IntSpsc_init(&spsc, 1024, NULL);
+
+  pthread_t producer;
+  pthread_create(&producer, NULL, spsc_producer, &spsc);
+
+  isize expected = 0;
+  bool in_order = true;
+  isize batch[32];
+  while (expected < COUNT) {
+    isize n = IntSpsc_pop_array(&spsc, batch, 32);
+    for (isize i = 0; i < n; ++i) in_order &= batch[i] == expected++;
+    isize val;
+    if (IntSpsc_pop(&spsc, &val)) in_order &= val == expected++;
+  }
+  pthread_join(producer, NULL);
+
+  printf("SPSC: received %ld values, in order: %d, left: %ld\n", expected, in_order, IntSpsc_len(&spsc));
+  IntSpsc_free(&spsc);
+
+  IntMpmc mpmc;
+  IntMpmc_init(&mpmc, 256, NULL);
+  pthread_t threads[2 * MPMC_THREADS];
+  MpmcWorker workers[2 * MPMC_THREADS] = {0};
+  rangefor(isize, i, 0, MPMC_THREADS) {
+    workers[i] = (MpmcWorker) { &mpmc, i, 0 };
+    workers[MPMC_THREADS + i] = (MpmcWorker) { &mpmc, i, 0 };
+    pthread_create(&threads[i], NULL, mpmc_producer, &workers[i]);
+    pthread_create(&threads[MPMC_THREADS + i], NULL, mpmc_consumer, &workers[MPMC_THREADS + i]);
+  }
+
+  isize sum = 0;
+  rangefor(isize, i, 0, 2 * MPMC_THREADS) {
+    pthread_join(threads[i], NULL);
+    sum += workers[i].sum;
+  }
+  printf("MPMC: sum %ld, expected %ld, left: %ld\n", sum, (isize) COUNT * (COUNT - 1) / 2, IntMpmc_len(&mpmc));
+  IntMpmc_free(&mpmc);
+}
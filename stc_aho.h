@@ -0,0 +1,318 @@
+#ifndef STC_AHO_IMPL
+#define STC_AHO_IMPL
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "stc_defs.h"
+#include "stc_mem.h"
+#include "stc_str.h"
+
+/*
+  Aho-Corasick multi pattern search.
+  https://cr.yp.to/bib/1975/aho.pdf
+  https://github.com/BurntSushi/aho-corasick/blob/master/DESIGN.md
+  The trie of the patterns is compiled to a DFA: every state has a transition for every byte,
+  so the search does exactly one table lookup per byte, whatever the number of patterns.
+  To keep the table small, bytes which behave the same (those not in any pattern, mostly)
+  share a byte class, and the table has a column per class.
+  Matches are reported in order of end offset, longest first for the same end, then in pattern order.
+  Empty patterns are not supported.
+*/
+
+// Teddy: finds the positions where the first bytes of some pattern may start, 16 at a time.
+// https://github.com/BurntSushi/aho-corasick/tree/master/src/packed/teddy
+#define AHO_TEDDY_MAX_PATTERNS 64
+#define AHO_TEDDY_BUCKETS 8
+#define AHO_TEDDY_MAX_LEN 3
+
+typedef struct {
+  // how many bytes of the patterns are fingerprinted
+  int len;
+  // for each fingerprint byte, the buckets having a pattern with that low/high nibble
+  u8 lo[AHO_TEDDY_MAX_LEN][16];
+  u8 hi[AHO_TEDDY_MAX_LEN][16];
+} AhoTeddy;
+
+typedef struct {
+  isize pattern;
+  // where the match starts in the haystack
+  isize offset;
+} AhoMatch;
+
+list_def(AhoMatch, AhoMatchList)
+
+// return false to stop the search
+typedef bool (*AhoMatchFn)(void* ctx, AhoMatch m);
+
+typedef struct {
+  isize states_len;
+  isize classes_len;
+  u8 classes[256];
+  // states_len * classes_len transitions
+  u32* delta;
+  u32* fail;
+  // the nearest state on the fail chain, this included, where some pattern ends, or 0
+  u32* out;
+  // first pattern ending in each state, or -1; patterns_next chains equal patterns
+  i32* own;
+  i32* patterns_next;
+  isize* patterns_lens;
+  isize patterns_len;
+  bool has_teddy;
+  AhoTeddy teddy;
+} AhoCorasick;
+
+void aho_teddy_init(AhoTeddy* t, StrList patterns, isize min_len) {
+  *t = (AhoTeddy) {0};
+  t->len = min_len < AHO_TEDDY_MAX_LEN ? min_len : AHO_TEDDY_MAX_LEN;
+  for (isize p=0; p<patterns.len; ++p) {
+    const u8* x = (const u8*) patterns.data[p].data;
+    // patterns with the same first byte go in the same bucket, so buckets mix fewer nibbles
+    u8 bucket = 1 << (x[0] % AHO_TEDDY_BUCKETS);
+    for (int j=0; j<t->len; ++j) {
+      t->lo[j][x[j] & 0xf] |= bucket;
+      t->hi[j][x[j] >> 4] |= bucket;
+    }
+  }
+}
+
+bool aho_teddy_candidate(const AhoTeddy* t, const u8* x) {
+  u8 res = 0xff;
+  for (int j=0; j<t->len; ++j) res &= t->lo[j][x[j] & 0xf] & t->hi[j][x[j] >> 4];
+  return res != 0;
+}
+
+isize aho_teddy_find_scalar(const AhoTeddy* t, const char* hay, isize n, isize i) {
+  for (; i + t->len <= n; ++i) {
+    if (aho_teddy_candidate(t, (const u8*) hay + i)) return i;
+  }
+  return -1;
+}
+
+#if (defined(__x86_64__) || defined(__i386__)) && !defined(STC_NO_SIMD)
+#define STC_AHO_TEDDY_SIMD
+#include <immintrin.h>
+
+// pshufb looks up 16 nibbles at once in the 16 byte tables
+__attribute__((target("ssse3")))
+isize aho_teddy_find_ssse3(const AhoTeddy* t, const char* hay, isize n, isize i) {
+  __m128i nibble = _mm_set1_epi8(0xf);
+  __m128i lo[AHO_TEDDY_MAX_LEN], hi[AHO_TEDDY_MAX_LEN];
+  for (int j=0; j<t->len; ++j) {
+    lo[j] = _mm_loadu_si128((const __m128i*) t->lo[j]);
+    hi[j] = _mm_loadu_si128((const __m128i*) t->hi[j]);
+  }
+
+  for (; i + t->len - 1 + 16 <= n; i += 16) {
+    __m128i res = _mm_set1_epi8(-1);
+    for (int j=0; j<t->len; ++j) {
+      __m128i v = _mm_loadu_si128((const __m128i*) (hay + i + j));
+      __m128i l = _mm_shuffle_epi8(lo[j], _mm_and_si128(v, nibble));
+      __m128i h = _mm_shuffle_epi8(hi[j], _mm_and_si128(_mm_srli_epi16(v, 4), nibble));
+      res = _mm_and_si128(res, _mm_and_si128(l, h));
+    }
+    u32 mask = ~_mm_movemask_epi8(_mm_cmpeq_epi8(res, _mm_setzero_si128())) & 0xffff;
+    if (mask != 0) return i + __builtin_ctz(mask);
+  }
+  return aho_teddy_find_scalar(t, hay, n, i);
+}
+
+bool aho_cpu_has_ssse3() {
+  return __builtin_cpu_supports("ssse3");
+}
+#endif
+
+// the first position from i where a pattern may start, or -1
+isize aho_teddy_find(const AhoTeddy* t, const char* hay, isize n, isize i) {
+#ifdef STC_AHO_TEDDY_SIMD
+  if (aho_cpu_has_ssse3()) return aho_teddy_find_ssse3(t, hay, n, i);
+#endif
+  return aho_teddy_find_scalar(t, hay, n, i);
+}
+
+/////////////////////
+
+#define AHO_NONE ((u32) -1)
+
+u32* aho_row(AhoCorasick* ac, u32 state) {
+  return ac->delta + (isize) state * ac->classes_len;
+}
+
+// Patterns are not copied, and may be freed after this.
+AhoCorasick aho_new(StrList patterns) {
+  AhoCorasick ac = {0};
+  assert(patterns.len > 0 && "aho corasick needs at least a pattern");
+  assert(patterns.len <= INT32_MAX && "too many patterns");
+
+  // byte classes: each byte in some pattern has its own, all the others share the last one
+  bool used[256] = {0};
+  isize total_len = 0, min_len = patterns.data[0].len;
+  for (isize p=0; p<patterns.len; ++p) {
+    str pat = patterns.data[p];
+    assert(pat.len > 0 && "empty patterns are not supported");
+    for (isize i=0; i<pat.len; ++i) used[(u8) pat.data[i]] = true;
+    total_len += pat.len;
+    if (pat.len < min_len) min_len = pat.len;
+  }
+  ac.classes_len = 0;
+  for (int c=0; c<256; ++c) {
+    if (used[c]) ac.classes[c] = ac.classes_len++;
+  }
+  if (ac.classes_len < 256) {
+    for (int c=0; c<256; ++c) {
+      if (!used[c]) ac.classes[c] = ac.classes_len;
+    }
+    ac.classes_len += 1;
+  }
+
+  isize max_states = total_len + 1;
+  assert(max_states < AHO_NONE && "patterns too long");
+  ac.delta = allocator_alloc(NULL, sizeof(u32) * max_states * ac.classes_len, _Alignof(u32));
+  ac.own = allocator_alloc(NULL, sizeof(i32) * max_states, _Alignof(i32));
+  ac.patterns_next = allocator_alloc(NULL, sizeof(i32) * patterns.len, _Alignof(i32));
+  ac.patterns_lens = allocator_alloc(NULL, sizeof(isize) * patterns.len, _Alignof(isize));
+  assert(ac.delta != NULL && ac.own != NULL && ac.patterns_next != NULL && ac.patterns_lens != NULL && "aho corasick alloc failed");
+  ac.patterns_len = patterns.len;
+
+  // the trie
+  ac.states_len = 1;
+  memset(ac.delta, 0xff, sizeof(u32) * ac.classes_len);
+  ac.own[0] = -1;
+  // backwards, so that the chains of equal patterns are in order
+  for (isize p=patterns.len-1; p>=0; --p) {
+    str pat = patterns.data[p];
+    u32 state = 0;
+    for (isize i=0; i<pat.len; ++i) {
+      u32* row = aho_row(&ac, state);
+      u8 c = ac.classes[(u8) pat.data[i]];
+      if (row[c] == AHO_NONE) {
+        u32 next = ac.states_len++;
+        memset(aho_row(&ac, next), 0xff, sizeof(u32) * ac.classes_len);
+        ac.own[next] = -1;
+        row[c] = next;
+      }
+      state = row[c];
+    }
+    ac.patterns_lens[p] = pat.len;
+    ac.patterns_next[p] = ac.own[state];
+    ac.own[state] = p;
+  }
+
+  ac.fail = allocator_alloc(NULL, sizeof(u32) * ac.states_len, _Alignof(u32));
+  ac.out = allocator_alloc(NULL, sizeof(u32) * ac.states_len, _Alignof(u32));
+  u32* queue = allocator_alloc(NULL, sizeof(u32) * ac.states_len, _Alignof(u32));
+  assert(ac.fail != NULL && ac.out != NULL && queue != NULL && "aho corasick alloc failed");
+
+  // breadth first, so that fail links point to already completed states
+  isize head = 0, tail = 0;
+  ac.fail[0] = 0;
+  ac.out[0] = 0;
+  u32* root = aho_row(&ac, 0);
+  for (isize c=0; c<ac.classes_len; ++c) {
+    if (root[c] == AHO_NONE) root[c] = 0;
+    else {
+      ac.fail[root[c]] = 0;
+      queue[tail++] = root[c];
+    }
+  }
+  while (head < tail) {
+    u32 state = queue[head++];
+    ac.out[state] = ac.own[state] >= 0 ? state : ac.out[ac.fail[state]];
+    u32* row = aho_row(&ac, state);
+    u32* fail_row = aho_row(&ac, ac.fail[state]);
+    for (isize c=0; c<ac.classes_len; ++c) {
+      if (row[c] == AHO_NONE) row[c] = fail_row[c];
+      else {
+        ac.fail[row[c]] = fail_row[c];
+        queue[tail++] = row[c];
+      }
+    }
+  }
+  allocator_free(NULL, queue, sizeof(u32) * ac.states_len);
+
+  // give back the states not used because of shared prefixes
+  ac.delta = allocator_realloc(NULL, ac.delta, sizeof(u32) * max_states * ac.classes_len, sizeof(u32) * ac.states_len * ac.classes_len, _Alignof(u32));
+  ac.own = allocator_realloc(NULL, ac.own, sizeof(i32) * max_states, sizeof(i32) * ac.states_len, _Alignof(i32));
+
+  ac.has_teddy = patterns.len <= AHO_TEDDY_MAX_PATTERNS;
+  if (ac.has_teddy) aho_teddy_init(&ac.teddy, patterns, min_len);
+  return ac;
+}
+
+void aho_free(AhoCorasick* ac) {
+  allocator_free(NULL, ac->delta, sizeof(u32) * ac->states_len * ac->classes_len);
+  allocator_free(NULL, ac->fail, sizeof(u32) * ac->states_len);
+  allocator_free(NULL, ac->out, sizeof(u32) * ac->states_len);
+  allocator_free(NULL, ac->own, sizeof(i32) * ac->states_len);
+  allocator_free(NULL, ac->patterns_next, sizeof(i32) * ac->patterns_len);
+  allocator_free(NULL, ac->patterns_lens, sizeof(isize) * ac->patterns_len);
+  *ac = (AhoCorasick) {0};
+}
+
+// the prefilter is dropped when, after this many calls, it skipped less than AHO_PREFILTER_MIN_SKIP bytes per call
+#define AHO_PREFILTER_MIN_CALLS 64
+#define AHO_PREFILTER_MIN_SKIP 4
+
+/*
+  Calls fn for every match of every pattern in s, overlapping ones included.
+  Returns how many matches were reported.
+*/
+isize aho_find_each(const AhoCorasick* ac, str s, AhoMatchFn fn, void* ctx) {
+  const u8* x = (const u8*) s.data;
+  isize found = 0;
+  bool prefilter = ac->has_teddy;
+  isize calls = 0, skipped = 0;
+
+  u32 state = 0;
+  for (isize i=0; i<s.len; ++i) {
+    // in the root state, nothing is partially matched: jump to where some pattern may start
+    if (state == 0 && prefilter) {
+      isize next = aho_teddy_find(&ac->teddy, s.data, s.len, i);
+      if (next == -1) break;
+      calls += 1;
+      skipped += next - i;
+      i = next;
+      if (calls >= AHO_PREFILTER_MIN_CALLS && skipped < calls * AHO_PREFILTER_MIN_SKIP) prefilter = false;
+    }
+
+    state = ac->delta[(isize) state * ac->classes_len + ac->classes[x[i]]];
+    for (u32 t = ac->out[state]; t != 0; t = ac->out[ac->fail[t]]) {
+      for (i32 p = ac->own[t]; p >= 0; p = ac->patterns_next[p]) {
+        found += 1;
+        AhoMatch m = { p, i + 1 - ac->patterns_lens[p] };
+        if (!fn(ctx, m)) return found;
+      }
+    }
+  }
+  return found;
+}
+
+bool aho_push_match(void* ctx, AhoMatch m) {
+  AhoMatchList_push(ctx, m);
+  return true;
+}
+
+// Appends all matches in s to out.
+void aho_find_all(const AhoCorasick* ac, str s, AhoMatchList* out) {
+  aho_find_each(ac, s, aho_push_match, out);
+}
+
+bool aho_stop_at_match(void* ctx, AhoMatch m) {
+  *(AhoMatch*) ctx = m;
+  return false;
+}
+
+// Finds the match which ends first; returns false if there are none.
+bool aho_find_first(const AhoCorasick* ac, str s, AhoMatch* out) {
+  AhoMatch m;
+  if (aho_find_each(ac, s, aho_stop_at_match, &m) == 0) return false;
+  if (out != NULL) *out = m;
+  return true;
+}
+
+bool aho_is_match(const AhoCorasick* ac, str s) {
+  return aho_find_first(ac, s, NULL);
+}
+
+#endif
@@ -16,19 +16,15 @@
 // TODO: better logging
 // TODO: async command running (create new process and wait for it)
 
+bool dir_entry_is_c_source(const DirEntry* e) {
+  str name = SVC(e->name);
+  return str_ends_with(name, SV(".c")) || str_ends_with(name, SV(".h"));
+}
+
 CstrList get_all_c_sources_in_dir(char* dirpath, bool recursive) {
   DirEntries entries = dir_entries(dirpath, recursive);
-  
-  isize curr = 0;
-  listforeach(DirEntry, e, &entries) {
-    str name = SVC(e->name);
-    if (str_ends_with(name, SV(".c")) || str_ends_with(name, SV(".h"))) {
-      entries.data[curr++] = *e;
-    } else {
-      DirEntry_free(e);
-    }
-  }
-  entries.len = curr;
+  // frees the entries which are not kept
+  DirEntries_retain(&entries, dir_entry_is_c_source);
 
   CstrList filenames = {0};
   listforeach(DirEntry, e, &entries) {
@@ -49,6 +45,14 @@ CstrList get_all_c_sources_in_dir(char* dirpath, bool recursive) {
   return filenames;
 }
 
+// frees the filenames from get_all_c_sources_in_dir(), which were allocated by a String
+void c_sources_free(CstrList* filenames) {
+  listforeach(char*, s, filenames) {
+    allocator_free(NULL, *s, strlen(*s) + 1);
+  }
+  CstrList_free(filenames);
+}
+
 bool binary_needs_rebuild(char* binpath, char** sources, isize sources_count) {
 #ifndef _WIN32
   struct stat statbuf;
@@ -142,20 +146,9 @@ int binary_rebuild_flags(char* binpath, char** flags, isize flags_count, char**
     CstrList_push(&cmd_cmp, flags[i]);
   }
 
-  // push inputs and sanitize
+  // push inputs; cmd_render() quotes those with spaces
   rangefor(isize, i, 0, sources_count) {
-    if (strchr(sources[i], ' ')) {
-      String sb = {0};
-      String_push(&sb, '"');
-      String_append_cstr(&sb, sources[i]);
-      String_push(&sb, '"');
-      String_append_null(&sb);
-
-      // memory leak here, we dont care
-      CstrList_push(&cmd_cmp, sb.data);
-    } else {
-      CstrList_push(&cmd_cmp, sources[i]);
-    }
+    CstrList_push(&cmd_cmp, sources[i]);
   }
 
   // push output
@@ -173,7 +166,7 @@ int binary_rebuild_flags(char* binpath, char** flags, isize flags_count, char**
 
   // Temporary command caller
   int res = system(build_cmd);
-  free(build_cmd);
+  String_free(&cmd);
   return res;
 }
 
@@ -244,6 +237,7 @@ int binary_rebuild_all(char** sources, isize sources_count) {
     String binpath = String_from_str(filename);
     path_set_extension(&binpath, BIN_EXTENSION);
     success += binary_rebuild(binpath.data, sources + i, 1) == 0 ? 1 : 0;
+    String_free(&binpath);
   }
 
   return success;
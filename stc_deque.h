@@ -1,258 +1,546 @@
+#ifndef STC_DEQUE_IMPL
+#define STC_DEQUE_IMPL
+
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
 #include "stc_defs.h"
-
-typedef struct {
-  isize cap, len;
-  isize front, back;
-  int* data;
-} Deque;
+#include "stc_mem.h"
 
 // https://stackoverflow.com/questions/49072494/how-does-the-vecdeque-ring-buffer-work-internally
 // https://doc.rust-lang.org/std/collections/struct.VecDeque.html
 
 // TODO: deque iterator
-// TODO: negative modulo?
 // TODO: should out of bounds access panic or return bool?
-// TODO: generalize with macro
-
-void deque_reserve(Deque* d, isize new_cap) {
-  if (new_cap > d->cap) {
-    d->cap = d->cap == 0 ? 16 : d->cap;
-
-    while (new_cap > d->cap) d->cap *= 2;
-    d->data = realloc(d->data, sizeof(int) * d->cap);
-    assert(d->data != NULL && "deque realloc failed");
-
-    if (d->front <= d->back) return;
-
-    isize back_len  = d->back;
-    isize front_len = d->len - d->front;
-
-    if (back_len < front_len) {
-      memcpy(
-        d->data + d->len,
-        d->data,
-        back_len * sizeof(int)
-      );
-      d->back = d->len + back_len;
-    } else {
-      /* might overlap? */
-      memmove(
-        d->data + (d->cap - front_len),
-        d->data + d->front,
-        front_len * sizeof(int)
-      );
-      d->front = d->cap - front_len;
-    }
-  }
-}
-
-void deque_push_back(Deque* d, int value) {
-  // we always have to be sure to realloc before computing the new back
-  d->len += 1;
-  deque_reserve(d, d->len+1);
-
-  d->data[d->back] = value;
-  d->back = (d->back + 1) & (d->cap - 1);
-}
-
-void deque_push_ring(Deque* d, int value) {
-  /* this will overwrite data if full */
-  d->len += 1;
-  d->data[d->back] = value;
-  d->back = (d->back + 1) & (d->cap - 1);
-}
-
-int deque_pop_back(Deque* d) {
-  assert(d->len > 0 && "popped empty deque");
-
-  if (d->back == 0) d->back = d->cap - 1;
-  else d->back = (d->back - 1) & (d->cap - 1);
-  d->len -= 1;
-  
-  return d->data[d->back];
-}
-
-void deque_push_front(Deque* d, int value) {
-  d->len += 1;
-  deque_reserve(d, d->len+1);
-  
-  if (d->front == 0) d->front = d->cap-1;
-  else d->front = (d->front - 1) & (d->cap - 1);
-
-  d->data[d->front] = value;
-}
-
-int deque_pop_front(Deque* d) {
-  assert(d->len > 0 && "popped empty queue");
-
-  int value = d->data[d->front];
-  d->front = (d->front + 1) & (d->cap - 1);
-  d->len += 1;
-  return value;
-}
-
-int deque_idx(Deque* d, isize i) {
-  assert(i < d->len && "deque access out of bounds");
-  return (d->front + i) & (d->cap - 1);
-}
-
-int* deque_get(Deque* d, isize i) {
-  return &d->data[deque_idx(d, i)];
-}
-
-void deque_set(Deque* d, isize i, int value) {
-  d->data[deque_idx(d, i)] = value;
-}
-
-int deque_back(Deque* d) {
-  assert(d->len > 0 && "accessed empty queue");
-  isize back;
-  if (d->back == 0) back = d->cap - 1;
-  else back = (d->back - 1) & (d->cap - 1);
-  return d->data[back];
-}
-
-int deque_front(Deque* d) {
-  assert(d->len > 0 && "accessed empty queue");
-  return d->data[d->front];
-}
-
-void deque_swap(Deque* d, isize a, isize b) {
-  int *left = deque_get(d, a);
-  int *right = deque_get(d, b);
-  int tmp = *left;
-  deque_set(d, a, *right);
-  deque_set(d, b, tmp);
-}
-
-void deque_append_back(Deque* d, int* data, isize len) {
-  deque_reserve(d, d->len + len);
-  memcpy(d->data + d->back, data, len);
-  d->back += len;
-  d->len += len;
-}
-
-Deque deque_from_array(int* data, isize len) {
-  Deque res = {0};
-  deque_append_back(&res, data, len);
-  return res;
-}
-
-// TODO: this is confusing
-// void deque_resize(Deque* d, isize new_len, type value) {
-//   if (new_len <= d->len) {
-//     d->len = new_len;
-//     d->back = (new_len > d->back) ?  : new_len;
-//   } else {
-//     deque_reserve(d, new_len);
-//     isize range = (new_len - d->len);
-//     for (int i=d->back; i<range; ++i) {
-//       d->data[(d->back + i) & (d->cap - 1)] = value;
-//     }
-//     d->len = new_len;
-//     d->back = (d->back + range) & (d->cap - 1);
-//   }
-// }
-
-// TODO: deque_make_contiguos(Deque* d) {}
-
-void deque_free(Deque* d) {
-  free(d->data);
-  d->len = d->cap = d->front = d->back = 0;
-  d->data = NULL;
-}
-
-// TODO: generalize with macro
-// this will need a generic cmp function
-
-// https://en.wikipedia.org/wiki/Binary_heap
-typedef struct {
-  isize cap, len;
-  int* data;
-} BinaryHeap;
-
-void bheap_reserve(BinaryHeap* b, isize new_cap) {
-  if (new_cap > b->cap) {
-    b->cap = b->cap == 0 ? 16 : b->cap;
-    while (new_cap > b->cap) b->cap *= 2;
-
-    b->data = realloc(b->data, sizeof(int) * b->cap);
-    assert(b->data != NULL && "bheap realloc failed");
-  }
-}
-
-#define BHEAP_LEFT(i) (2*(i) + 1)
-#define BHEAP_RIGHT(i) (2*(i) + 2)
-#define BHEAP_PARENT(i) (((i)-1) / 2) 
-
-void bheap_swap(BinaryHeap* h, isize a, isize b) {
-  assert(a < h->len && "bheap access out of bounds");
-  assert(b < h->len && "bheap access out of bounds");
-  int tmp = h->data[a];
-  h->data[a] = h->data[b];
-  h->data[b] = tmp;
-}
-
-void bheap_push(BinaryHeap* b, int val) {
-  bheap_reserve(b, b->len+1);
-  
-  b->data[b->len++] = val;
-  if (b->len == 1) return;
-  
-  isize curr = b->len-1;
-  isize parent = BHEAP_PARENT(curr);
-  while (curr > 0 && b->data[curr] > b->data[parent]) {
-    bheap_swap(b, curr, parent);
-    curr = parent;
-    parent = BHEAP_PARENT(curr);
-  }
-}
-
-void bheap_heapify(BinaryHeap* b, isize root) {
-  isize curr = root;
-  
-  while (true) {
-    isize left  = BHEAP_LEFT(curr);
-    isize right = BHEAP_RIGHT(curr);
-
-    isize largest = curr;
-    if (left  < b->len && b->data[left]  > b->data[largest]) largest = left;
-    if (right < b->len && b->data[right] > b->data[largest]) largest = right;
-    if (largest == curr) break;
-    bheap_swap(b, curr, largest);
-    curr = largest;
-  }
-}
-
-int bheap_pop(BinaryHeap* b) {
-  assert(b->len > 0 && "popping empty bheap");
-
-  int res = b->data[b->len--];
-  if (b->len == 0) return res;
-
-  b->data[0] = b->data[b->len];
-  bheap_heapify(b, 0);
-
-  return res;
-}
-
-int bheap_push_pop(BinaryHeap* b, int val) {
-  if (b->len == 0 || b->data[0] > val) return val;
- 
-  int res = b->data[0];
-  b->data[b->len] = val;
-  bheap_swap(b, 0, b->len);
-  bheap_heapify(b, 0);
-  return res;
-}
 
-BinaryHeap bheap_from_array(const int* arr, isize arr_len) {
-  isize start = arr_len / 2 - 1;
-  BinaryHeap b = {0};
-  memcpy(b.data, arr, arr_len * sizeof(int));
-  for(isize i=start; i >= 0; --i) bheap_heapify(&b, i);
-  return b;
-}
\ No newline at end of file
+static const isize DEQUE_DEFAULT_CAP = 16;
+
+/*
+  Ring buffer: elements go from front, wrapping around at cap, for len elements.
+  cap is always a power of two, so wrapping an index is just a mask with (cap - 1).
+  The elements are always in at most two contiguous pieces: [front, cap) and [0, back).
+*/
+#define deque_def(type, name) \
+typedef struct { \
+  isize cap, len; \
+  isize front; \
+  type* data; \
+  const Allocator* alloc; \
+} name; \
+ \
+typedef struct { \
+  type* first; \
+  isize first_len; \
+  type* second; \
+  isize second_len; \
+} name##Slices; \
+ \
+isize name##_wrap(const name* d, isize i) { \
+  return i & (d->cap - 1); \
+} \
+ \
+isize name##_idx(const name* d, isize i) { \
+  assert(i < d->len && "deque access out of bounds"); \
+  return name##_wrap(d, d->front + i); \
+} \
+ \
+void name##_reserve(name* d, isize new_cap) { \
+  if (new_cap <= d->cap) return; \
+ \
+  isize old_cap = d->cap; \
+  isize cap = d->cap == 0 ? DEQUE_DEFAULT_CAP : d->cap; \
+  while (new_cap > cap) cap *= 2; \
+  d->data = allocator_realloc(d->alloc, d->data, sizeof(type) * old_cap, sizeof(type) * cap, _Alignof(type)); \
+  assert(d->data != NULL && "deque realloc failed"); \
+  d->cap = cap; \
+ \
+  /* not wrapped around, nothing else to do */ \
+  if (d->front + d->len <= old_cap) return; \
+ \
+  isize head_len = old_cap - d->front; \
+  isize tail_len = d->len - head_len; \
+  if (tail_len < head_len) { \
+    /* move the wrapped tail right after the old end; cap at least doubled, so it fits */ \
+    memcpy(d->data + old_cap, d->data, tail_len * sizeof(type)); \
+  } else { \
+    /* move the head to the end of the new buffer */ \
+    memmove(d->data + (cap - head_len), d->data + d->front, head_len * sizeof(type)); \
+    d->front = cap - head_len; \
+  } \
+} \
+ \
+void name##_push_back(name* d, type value) { \
+  name##_reserve(d, d->len + 1); \
+  d->data[name##_wrap(d, d->front + d->len)] = value; \
+  d->len += 1; \
+} \
+ \
+/* like push_back, but when full overwrites the front element instead of growing */ \
+void name##_push_ring(name* d, type value) { \
+  if (d->cap == 0) name##_reserve(d, 1); \
+  d->data[name##_wrap(d, d->front + d->len)] = value; \
+  if (d->len == d->cap) d->front = name##_wrap(d, d->front + 1); \
+  else d->len += 1; \
+} \
+ \
+void name##_push_front(name* d, type value) { \
+  name##_reserve(d, d->len + 1); \
+  d->front = name##_wrap(d, d->front - 1); \
+  d->data[d->front] = value; \
+  d->len += 1; \
+} \
+ \
+type name##_pop_back(name* d) { \
+  assert(d->len > 0 && "popped empty deque"); \
+  d->len -= 1; \
+  return d->data[name##_wrap(d, d->front + d->len)]; \
+} \
+ \
+type name##_pop_front(name* d) { \
+  assert(d->len > 0 && "popped empty deque"); \
+  type value = d->data[d->front]; \
+  d->front = name##_wrap(d, d->front + 1); \
+  d->len -= 1; \
+  return value; \
+} \
+ \
+type* name##_get(const name* d, isize i) { \
+  return &d->data[name##_idx(d, i)]; \
+} \
+ \
+void name##_set(name* d, isize i, type value) { \
+  d->data[name##_idx(d, i)] = value; \
+} \
+ \
+type* name##_front(const name* d) { \
+  assert(d->len > 0 && "accessed empty deque"); \
+  return &d->data[d->front]; \
+} \
+ \
+type* name##_back(const name* d) { \
+  assert(d->len > 0 && "accessed empty deque"); \
+  return &d->data[name##_wrap(d, d->front + d->len - 1)]; \
+} \
+ \
+void name##_swap(name* d, isize a, isize b) { \
+  type* left  = name##_get(d, a); \
+  type* right = name##_get(d, b); \
+  type tmp = *left; \
+  *left = *right; \
+  *right = tmp; \
+} \
+ \
+/* the elements, in order, as two contiguous slices; second is empty if not wrapped */ \
+name##Slices name##_as_slices(const name* d) { \
+  if (d->front + d->len <= d->cap) { \
+    return (name##Slices) { d->data + d->front, d->len, d->data, 0 }; \
+  } \
+  isize head_len = d->cap - d->front; \
+  return (name##Slices) { d->data + d->front, head_len, d->data, d->len - head_len }; \
+} \
+ \
+/* copies arr_len elements from arr in the ring, starting from index start, with at most two memcpy */ \
+void name##_copy_in(name* d, isize start, const type* arr, isize arr_len) { \
+  isize first_len = d->cap - start; \
+  if (first_len > arr_len) first_len = arr_len; \
+  memcpy(d->data + start, arr, first_len * sizeof(type)); \
+  memcpy(d->data, arr + first_len, (arr_len - first_len) * sizeof(type)); \
+} \
+ \
+void name##_append_back(name* d, const type* arr, isize arr_len) { \
+  if (arr_len == 0) return; \
+  name##_reserve(d, d->len + arr_len); \
+  name##_copy_in(d, name##_wrap(d, d->front + d->len), arr, arr_len); \
+  d->len += arr_len; \
+} \
+ \
+/* arr keeps its order: arr[0] becomes the new front */ \
+void name##_append_front(name* d, const type* arr, isize arr_len) { \
+  if (arr_len == 0) return; \
+  name##_reserve(d, d->len + arr_len); \
+  d->front = name##_wrap(d, d->front - arr_len); \
+  name##_copy_in(d, d->front, arr, arr_len); \
+  d->len += arr_len; \
+} \
+ \
+/* pops up to n elements from the front into out, with at most two memcpy; returns how many */ \
+isize name##_pop_front_array(name* d, type* out, isize n) { \
+  if (n > d->len) n = d->len; \
+  if (n == 0) return 0; \
+  isize first_len = d->cap - d->front; \
+  if (first_len > n) first_len = n; \
+  memcpy(out, d->data + d->front, first_len * sizeof(type)); \
+  memcpy(out + first_len, d->data, (n - first_len) * sizeof(type)); \
+  d->front = name##_wrap(d, d->front + n); \
+  d->len -= n; \
+  return n; \
+} \
+ \
+void name##_reverse_range(type* data, isize start, isize end) { \
+  for (isize l = start, r = end - 1; l < r; ++l, --r) { \
+    type tmp = data[l]; \
+    data[l] = data[r]; \
+    data[r] = tmp; \
+  } \
+} \
+ \
+/* \
+  Rearranges the elements in place so that they are contiguous, without allocating. \
+  Returns a pointer to the first element; the following len-1 are the rest of the deque. \
+*/ \
+type* name##_make_contiguous(name* d) { \
+  if (d->front + d->len <= d->cap) return d->data + d->front; \
+ \
+  isize head_len = d->cap - d->front; \
+  isize tail_len = d->len - head_len; \
+  isize free_len = d->cap - d->len; \
+ \
+  if (free_len >= head_len) { \
+    /* [tail . . head] -> [head tail . .] */ \
+    memmove(d->data + head_len, d->data, tail_len * sizeof(type)); \
+    memcpy(d->data, d->data + d->front, head_len * sizeof(type)); \
+    d->front = 0; \
+  } else if (free_len >= tail_len) { \
+    /* [tail . . head] -> [tail head tail] */ \
+    memmove(d->data + tail_len, d->data + d->front, head_len * sizeof(type)); \
+    memcpy(d->data + tail_len + head_len, d->data, tail_len * sizeof(type)); \
+    d->front = tail_len; \
+  } else { \
+    /* not enough space to move either piece; rotate the whole buffer left by front */ \
+    name##_reverse_range(d->data, 0, d->front); \
+    name##_reverse_range(d->data, d->front, d->cap); \
+    name##_reverse_range(d->data, 0, d->cap); \
+    d->front = 0; \
+  } \
+  return d->data + d->front; \
+} \
+ \
+name name##_from_array(const type* arr, isize arr_len) { \
+  name res = {0}; \
+  name##_append_back(&res, arr, arr_len); \
+  return res; \
+} \
+ \
+void name##_clear(name* d) { \
+  d->len = d->front = 0; \
+} \
+ \
+void name##_free(name* d) { \
+  allocator_free(d->alloc, d->data, sizeof(type) * d->cap); \
+  d->len = d->cap = d->front = 0; \
+  d->data = NULL; \
+} \
+
+deque_def(int, Deque)
+
+/*
+  Implicit d-ary heap: the children of i are at [arity*i + 1, arity*i + arity].
+  https://en.wikipedia.org/wiki/D-ary_heap
+  less(a, b) is a macro or function on two values; the top is the element no other is less than,
+  so HEAP_LESS gives a min heap and HEAP_GREATER a max heap.
+  Higher arities make the heap shallower: sift down compares more siblings per level,
+  but they sit next to each other, and there are less levels to miss in cache. 4 is usually best.
+  Sifts move a hole instead of swapping, so each level costs a single copy.
+*/
+#define HEAP_LESS(a, b) ((a) < (b))
+#define HEAP_GREATER(a, b) ((a) > (b))
+
+static const isize HEAP_DEFAULT_ARITY = 4;
+
+#define heap_def(type, name, less) heap_def_arity(type, name, less, HEAP_DEFAULT_ARITY)
+
+#define heap_def_arity(type, name, less, arity) \
+typedef struct { \
+  isize len, cap; \
+  type* data; \
+  const Allocator* alloc; \
+} name; \
+ \
+void name##_reserve(name* h, isize new_cap) { \
+  if (new_cap <= h->cap) return; \
+  isize cap = h->cap == 0 ? DEQUE_DEFAULT_CAP : h->cap; \
+  while (new_cap > cap) cap *= 2; \
+  h->data = allocator_realloc(h->alloc, h->data, sizeof(type) * h->cap, sizeof(type) * cap, _Alignof(type)); \
+  assert(h->data != NULL && "heap realloc failed"); \
+  h->cap = cap; \
+} \
+ \
+void name##_sift_up(name* h, isize i) { \
+  type val = h->data[i]; \
+  while (i > 0) { \
+    isize parent = (i - 1) / (arity); \
+    if (!less(val, h->data[parent])) break; \
+    h->data[i] = h->data[parent]; \
+    i = parent; \
+  } \
+  h->data[i] = val; \
+} \
+ \
+void name##_sift_down(name* h, isize i) { \
+  type val = h->data[i]; \
+  while (true) { \
+    isize first = (arity) * i + 1; \
+    if (first >= h->len) break; \
+    isize best = first; \
+    if (first + (arity) <= h->len) { \
+      /* all children present: constant trip count, the compiler can unroll it */ \
+      for (isize c = first + 1; c < first + (arity); ++c) { \
+        if (less(h->data[c], h->data[best])) best = c; \
+      } \
+    } else { \
+      for (isize c = first + 1; c < h->len; ++c) { \
+        if (less(h->data[c], h->data[best])) best = c; \
+      } \
+    } \
+    if (!less(h->data[best], val)) break; \
+    h->data[i] = h->data[best]; \
+    i = best; \
+  } \
+  h->data[i] = val; \
+} \
+ \
+/* restores the heap property over the whole array, in O(n) */ \
+void name##_rebuild(name* h) { \
+  if (h->len < 2) return; \
+  for (isize i = (h->len - 2) / (arity); i >= 0; --i) name##_sift_down(h, i); \
+} \
+ \
+void name##_push(name* h, type value) { \
+  name##_reserve(h, h->len + 1); \
+  h->data[h->len++] = value; \
+  name##_sift_up(h, h->len - 1); \
+} \
+ \
+/* when pushing more elements than the heap has, rebuilding it is cheaper than sifting each one */ \
+void name##_push_array(name* h, const type* arr, isize arr_len) { \
+  if (arr_len <= 0) return; \
+  name##_reserve(h, h->len + arr_len); \
+  memcpy(h->data + h->len, arr, arr_len * sizeof(type)); \
+  isize old_len = h->len; \
+  h->len += arr_len; \
+ \
+  if (arr_len >= old_len) name##_rebuild(h); \
+  else for (isize i=old_len; i<h->len; ++i) name##_sift_up(h, i); \
+} \
+ \
+type name##_top(const name* h) { \
+  assert(h->len > 0 && "top of empty heap"); \
+  return h->data[0]; \
+} \
+ \
+type name##_pop(name* h) { \
+  assert(h->len > 0 && "popping empty heap"); \
+  type res = h->data[0]; \
+  h->len -= 1; \
+  if (h->len > 0) { \
+    h->data[0] = h->data[h->len]; \
+    name##_sift_down(h, 0); \
+  } \
+  return res; \
+} \
+ \
+/* push followed by pop, with a single sift */ \
+type name##_push_pop(name* h, type value) { \
+  if (h->len == 0 || !less(h->data[0], value)) return value; \
+  type res = h->data[0]; \
+  h->data[0] = value; \
+  name##_sift_down(h, 0); \
+  return res; \
+} \
+ \
+/* pop followed by push, with a single sift */ \
+type name##_replace_top(name* h, type value) { \
+  assert(h->len > 0 && "replacing top of empty heap"); \
+  type res = h->data[0]; \
+  h->data[0] = value; \
+  name##_sift_down(h, 0); \
+  return res; \
+} \
+ \
+name name##_from_array(const type* arr, isize arr_len) { \
+  name res = {0}; \
+  name##_push_array(&res, arr, arr_len); \
+  return res; \
+} \
+ \
+void name##_clear(name* h) { \
+  h->len = 0; \
+} \
+ \
+void name##_free(name* h) { \
+  allocator_free(h->alloc, h->data, sizeof(type) * h->cap); \
+  h->len = h->cap = 0; \
+  h->data = NULL; \
+} \
+
+/*
+  Indexed heap: every element has a handle, an integer in [0, handles_cap) chosen by the user
+  (e.g. a graph node index). pos maps each handle to its position in the heap, or -1,
+  so the key of an element can be changed, or the element removed, in O(log n).
+  Heap entries keep their key next to the handle, so sifts don't chase pointers.
+  https://algs4.cs.princeton.edu/24pq/IndexMinPQ.java.html
+*/
+#define iheap_def(type, name, less) iheap_def_arity(type, name, less, HEAP_DEFAULT_ARITY)
+
+#define iheap_def_arity(type, name, less, arity) \
+typedef struct { \
+  type key; \
+  isize handle; \
+} name##Entry; \
+ \
+typedef struct { \
+  isize len, cap; \
+  name##Entry* data; \
+  isize handles_cap; \
+  isize* pos; \
+  const Allocator* alloc; \
+} name; \
+ \
+void name##_reserve(name* h, isize new_cap) { \
+  if (new_cap <= h->cap) return; \
+  isize cap = h->cap == 0 ? DEQUE_DEFAULT_CAP : h->cap; \
+  while (new_cap > cap) cap *= 2; \
+  h->data = allocator_realloc(h->alloc, h->data, sizeof(name##Entry) * h->cap, sizeof(name##Entry) * cap, _Alignof(name##Entry)); \
+  assert(h->data != NULL && "heap realloc failed"); \
+  h->cap = cap; \
+} \
+ \
+/* makes room for handles up to new_cap - 1 */ \
+void name##_reserve_handles(name* h, isize new_cap) { \
+  if (new_cap <= h->handles_cap) return; \
+  isize cap = h->handles_cap == 0 ? DEQUE_DEFAULT_CAP : h->handles_cap; \
+  while (new_cap > cap) cap *= 2; \
+  h->pos = allocator_realloc(h->alloc, h->pos, sizeof(isize) * h->handles_cap, sizeof(isize) * cap, _Alignof(isize)); \
+  assert(h->pos != NULL && "heap realloc failed"); \
+  for (isize i=h->handles_cap; i<cap; ++i) h->pos[i] = -1; \
+  h->handles_cap = cap; \
+} \
+ \
+void name##_sift_up(name* h, isize i) { \
+  name##Entry e = h->data[i]; \
+  while (i > 0) { \
+    isize parent = (i - 1) / (arity); \
+    if (!less(e.key, h->data[parent].key)) break; \
+    h->data[i] = h->data[parent]; \
+    h->pos[h->data[i].handle] = i; \
+    i = parent; \
+  } \
+  h->data[i] = e; \
+  h->pos[e.handle] = i; \
+} \
+ \
+void name##_sift_down(name* h, isize i) { \
+  name##Entry e = h->data[i]; \
+  while (true) { \
+    isize first = (arity) * i + 1; \
+    if (first >= h->len) break; \
+    isize last = first + (arity) < h->len ? first + (arity) : h->len; \
+    isize best = first; \
+    for (isize c = first + 1; c < last; ++c) { \
+      if (less(h->data[c].key, h->data[best].key)) best = c; \
+    } \
+    if (!less(h->data[best].key, e.key)) break; \
+    h->data[i] = h->data[best]; \
+    h->pos[h->data[i].handle] = i; \
+    i = best; \
+  } \
+  h->data[i] = e; \
+  h->pos[e.handle] = i; \
+} \
+ \
+bool name##_contains(const name* h, isize handle) { \
+  return handle >= 0 && handle < h->handles_cap && h->pos[handle] >= 0; \
+} \
+ \
+type name##_get(const name* h, isize handle) { \
+  assert(name##_contains(h, handle) && "handle not in heap"); \
+  return h->data[h->pos[handle]].key; \
+} \
+ \
+void name##_push(name* h, isize handle, type key) { \
+  assert(handle >= 0 && "negative heap handle"); \
+  name##_reserve_handles(h, handle + 1); \
+  assert(h->pos[handle] < 0 && "handle already in heap"); \
+  name##_reserve(h, h->len + 1); \
+  h->data[h->len] = (name##Entry) { key, handle }; \
+  h->len += 1; \
+  name##_sift_up(h, h->len - 1); \
+} \
+ \
+name##Entry name##_top(const name* h) { \
+  assert(h->len > 0 && "top of empty heap"); \
+  return h->data[0]; \
+} \
+ \
+/* removes the element at heap position i */ \
+name##Entry name##_remove_at(name* h, isize i) { \
+  name##Entry res = h->data[i]; \
+  h->pos[res.handle] = -1; \
+  h->len -= 1; \
+  if (i == h->len) return res; \
+ \
+  /* the last element may belong above or below the hole */ \
+  h->data[i] = h->data[h->len]; \
+  if (i > 0 && less(h->data[i].key, h->data[(i - 1) / (arity)].key)) name##_sift_up(h, i); \
+  else name##_sift_down(h, i); \
+  return res; \
+} \
+ \
+name##Entry name##_pop(name* h) { \
+  assert(h->len > 0 && "popping empty heap"); \
+  return name##_remove_at(h, 0); \
+} \
+ \
+type name##_remove(name* h, isize handle) { \
+  assert(name##_contains(h, handle) && "handle not in heap"); \
+  return name##_remove_at(h, h->pos[handle]).key; \
+} \
+ \
+/* key must not be greater than the current one: the element can only move toward the top */ \
+void name##_decrease_key(name* h, isize handle, type key) { \
+  assert(name##_contains(h, handle) && "handle not in heap"); \
+  isize i = h->pos[handle]; \
+  assert(!less(h->data[i].key, key) && "decrease_key would move the element down"); \
+  h->data[i].key = key; \
+  name##_sift_up(h, i); \
+} \
+ \
+/* key must not be less than the current one: the element can only move toward the bottom */ \
+void name##_increase_key(name* h, isize handle, type key) { \
+  assert(name##_contains(h, handle) && "handle not in heap"); \
+  isize i = h->pos[handle]; \
+  assert(!less(key, h->data[i].key) && "increase_key would move the element up"); \
+  h->data[i].key = key; \
+  name##_sift_down(h, i); \
+} \
+ \
+/* sets the key of handle, pushing it if not in the heap */ \
+void name##_update(name* h, isize handle, type key) { \
+  if (!name##_contains(h, handle)) { \
+    name##_push(h, handle, key); \
+    return; \
+  } \
+  isize i = h->pos[handle]; \
+  bool up = less(key, h->data[i].key); \
+  h->data[i].key = key; \
+  if (up) name##_sift_up(h, i); \
+  else name##_sift_down(h, i); \
+} \
+ \
+void name##_clear(name* h) { \
+  for (isize i=0; i<h->len; ++i) h->pos[h->data[i].handle] = -1; \
+  h->len = 0; \
+} \
+ \
+void name##_free(name* h) { \
+  allocator_free(h->alloc, h->data, sizeof(name##Entry) * h->cap); \
+  allocator_free(h->alloc, h->pos, sizeof(isize) * h->handles_cap); \
+  h->len = h->cap = h->handles_cap = 0; \
+  h->data = NULL; \
+  h->pos = NULL; \
+} \
+
+heap_def(int, IntHeap, HEAP_GREATER)
+iheap_def(i64, IndexHeap, HEAP_LESS)
+
+#endif
@@ -547,11 +547,12 @@ DirEntry* dir_read(DirIter* it) {
 
 #define dir_iter(ent, it) for(DirEntry* ent; (ent = dir_read((it))) != NULL;)
 
-list_def(DirEntry, DirEntries)
+list_def_owned(DirEntry, DirEntries, DirEntry_free)
+list_def_alg(DirEntry, DirEntries)
+
+// DirEntries_free() already frees all entries
 void DirEntries_drop(DirEntries* entries) {
-  if (entries->data == NULL) return;
-  listforeach(DirEntry, e, entries) DirEntry_free(e);
-  free(entries->data);
+  DirEntries_free(entries);
 }
 
 static DirEntries dir_entries_single(const char* dirpath) {
@@ -584,7 +585,8 @@ static DirEntries dir_entries_recursive(const char* dirpath) {
       path_pop(&subdir);
 
       DirEntries_append(&entries, rec);
-      // do not use DirEntries_drop; or else we invalidate pointers in entries too
+      // entries now own the elements of rec; empty it, so that free doesn't drop them
+      rec.len = 0;
       DirEntries_free(&rec);
     }
   }
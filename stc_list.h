@@ -3,8 +3,9 @@
 
 #include <string.h>
 #include <stdlib.h>
-#include <time.h>
 #include "stc_defs.h"
+#include "stc_mem.h"
+#include "stc_rand.h"
 
 #define rangefor(type, it, start, end) for (type it = (start); it < (end); ++it)
 #define listfor(type, it, list) for (type it = 0; it < (list)->len; ++it)
@@ -12,13 +13,22 @@
 #define listforeach(type, it, list) for (type* it = (list)->data; it < (list)->data + (list)->len; ++it)
 
 static const isize LIST_DEFAULT_CAP = 16; 
+// top_k() uses a heap when k is at most 1/LIST_TOP_K_HEAP_RATIO of the list length
+static const isize LIST_TOP_K_HEAP_RATIO = 16;
 
 // TODO: array_heap_to_list() is extremely dangerous
-// TODO: small size opt: https://nullprogram.com/blog/2016/10/07/
 // TODO: list_def probably defines too many functions
 
-// TODO: pop, remove, free, retain, filter, dedpu, are problematic, what if elemnt has to be freed?
-// should probably provide element destructor
+// https://en.wikipedia.org/wiki/Fowler%E2%80%93Noll%E2%80%93Vo_hash_function
+u64 list_hash_bytes(const void* data, isize len) {
+  const u8* bytes = data;
+  u64 hash = 0xcbf29ce484222325;
+  for (isize i=0; i<len; ++i) {
+    hash ^= bytes[i];
+    hash *= 0x100000001b3;
+  }
+  return hash;
+}
 
 #define FIRST(list) ((list).data[0])
 #define LAST(list) ((list).data[(list).len-1])
@@ -29,12 +39,30 @@ static const isize LIST_DEFAULT_CAP = 16;
  \
 
 
-#define list_def(type, name) \
+/*
+  Lists owning their elements: list_def_owned(type, name, drop_fn) calls drop_fn(type*)
+  on every element that is thrown away by free, clear, truncate, resize, retain, dedup.
+  pop and remove_swap move the element out of the list, so it's the caller's to drop.
+  clone, append and filter make shallow copies: only one of the lists should drop them.
+  Plain list_def() has nothing to drop, and skips those loops entirely.
+*/
+#define LIST_DROP_NONE(e) UNUSED(e)
+
+#define list_def(type, name) list_def_impl(type, name, LIST_DROP_NONE, false)
+#define list_def_owned(type, name, drop_fn) list_def_impl(type, name, drop_fn, true)
+
+#define list_def_impl(type, name, drop_fn, has_drop) \
 typedef struct { \
   isize len, cap; \
   type* data; \
+  const Allocator* alloc; \
 } name; \
  \
+enum { name##_has_drop = (has_drop) }; \
+void name##_drop_elem(type* e) { \
+  drop_fn(e); \
+} \
+ \
 name name##_with_cap(isize cap) { \
   /* https://stackoverflow.com/questions/466204/rounding-up-to-next-power-of-2 */ \
   if ((cap & (cap - 1)) != 0) { \
@@ -47,23 +75,43 @@ name name##_with_cap(isize cap) { \
     cap++; \
   } \
  \
-  type* data = malloc(cap * sizeof(type)); \
+  type* data = allocator_alloc(NULL, cap * sizeof(type), _Alignof(type)); \
   assert(data != NULL && "list realloc failed"); \
-  return (name) { 0, cap, data }; \
+  return (name) { 0, cap, data, NULL }; \
 } \
  \
 void name##_reserve(name* l, isize new_cap) { \
   if (new_cap > l->cap) { \
+    isize old_cap = l->cap; \
     l->cap = l->cap == 0 ? LIST_DEFAULT_CAP : l->cap; \
     while (new_cap > l->cap) l->cap *= 2; \
  \
-    l->data = realloc(l->data, sizeof(type) * l->cap); \
+    l->data = allocator_realloc(l->alloc, l->data, sizeof(type) * old_cap, sizeof(type) * l->cap, _Alignof(type)); \
     assert(l->data != NULL && "list realloc failed"); \
   } \
 } \
+/* all memory of the list will come from alloc, which has to outlive it */ \
+name name##_with_alloc(const Allocator* alloc, isize cap) { \
+  name res = { .alloc = alloc }; \
+  name##_reserve(&res, cap); \
+  return res; \
+} \
+ \
+void name##_truncate(name* l, isize new_len) { \
+  if (new_len >= l->len) return; \
+  if (name##_has_drop) { \
+    rangefor(isize, i, new_len, l->len) name##_drop_elem(&l->data[i]); \
+  } \
+  l->len = new_len; \
+} \
+ \
+void name##_clear(name* l) { \
+  name##_truncate(l, 0); \
+} \
+ \
 void name##_resize(name* l, isize new_len, type value) { \
   if (new_len <= l->len) { \
-    l->len = new_len; \
+    name##_truncate(l, new_len); \
   } else { \
     name##_reserve(l, l->len + new_len); \
     rangefor(int, i, l->len, new_len) { \
@@ -136,11 +184,161 @@ void name##_append(name* this, name other) { \
 } \
  \
 name name##_clone(name l) { \
-  return name##_from_array((const type*) l.data, l.len); \
+  name res = { .alloc = l.alloc }; \
+  name##_append_array(&res, (const type*) l.data, l.len); \
+  return res; \
+} \
+ \
+void name##_free(name* l) { \
+  name##_clear(l); \
+  allocator_free(l->alloc, l->data, sizeof(type) * l->cap); \
+  l->cap = 0; \
+  l->len = 0; \
+  l->data = NULL; \
+} \
+ \
+
+
+////////////////////////////////
+
+/*
+  Small size optimization: https://nullprogram.com/blog/2016/10/07/
+  Up to N elements are stored inline in the struct, and data points to buf.
+  It only spills to the heap when it grows past N, so small lists never call malloc.
+  A list is inline while cap <= N; on the heap cap is always bigger than N.
+
+  data points INSIDE the struct itself, so when the struct is moved (returned by value,
+  assigned to another variable), it points to the old copy. All methods fix it on entry;
+  if you access .data directly after a move, call name##_data() first.
+  first() and last() take a pointer, as returning a pointer into a by-value copy would dangle.
+*/
+#define list_def_small(type, name, N) \
+typedef struct { \
+  isize len, cap; \
+  type* data; \
+  const Allocator* alloc; \
+  type buf[N]; \
+} name; \
+ \
+type* name##_data(name* l) { \
+  if (l->cap > 0 && l->cap <= (N)) l->data = l->buf; \
+  return l->data; \
+} \
+ \
+enum { name##_has_drop = false }; \
+void name##_drop_elem(type* e) { \
+  UNUSED(e); \
+} \
+ \
+bool name##_is_inline(const name* l) { \
+  return l->cap <= (N); \
+} \
+ \
+void name##_reserve(name* l, isize new_cap) { \
+  name##_data(l); \
+  if (new_cap <= l->cap) return; \
+ \
+  if (new_cap <= (N)) { \
+    l->cap = (N); \
+    l->data = l->buf; \
+    return; \
+  } \
+ \
+  isize cap = l->cap <= (N) ? LIST_DEFAULT_CAP : l->cap; \
+  while (new_cap > cap) cap *= 2; \
+ \
+  if (l->cap <= (N)) { \
+    /* spill to the heap */ \
+    type* data = allocator_alloc(l->alloc, sizeof(type) * cap, _Alignof(type)); \
+    assert(data != NULL && "list realloc failed"); \
+    memcpy(data, l->buf, l->len * sizeof(type)); \
+    l->data = data; \
+  } else { \
+    l->data = allocator_realloc(l->alloc, l->data, sizeof(type) * l->cap, sizeof(type) * cap, _Alignof(type)); \
+    assert(l->data != NULL && "list realloc failed"); \
+  } \
+  l->cap = cap; \
+} \
+ \
+name name##_with_cap(isize cap) { \
+  name res = {0}; \
+  name##_reserve(&res, cap); \
+  return res; \
+} \
+ \
+void name##_resize(name* l, isize new_len, type value) { \
+  if (new_len <= l->len) { \
+    l->len = new_len; \
+  } else { \
+    name##_reserve(l, new_len); \
+    rangefor(isize, i, l->len, new_len) { \
+      l->data[i] = value; \
+    } \
+    l->len = new_len; \
+  } \
+} \
+ \
+void name##_push(name* l, type value) { \
+  name##_reserve(l, l->len + 1); \
+  l->data[l->len++] = value; \
+} \
+ \
+type* name##_first(name* l) { \
+  assert(l->len > 0 && "access to empty list"); \
+  return &name##_data(l)[0]; \
+} \
+type* name##_last(name* l) { \
+  assert(l->len > 0 && "access to empty list"); \
+  return &name##_data(l)[l->len-1]; \
+} \
+ \
+type name##_pop(name* l) { \
+  assert(l->len > 0 && "popped empty list"); \
+  return name##_data(l)[--l->len]; \
+} \
+ \
+void name##_swap(name* l, isize a, isize b) { \
+  assert(a < l->len && "index a out of bounds"); \
+  assert(b < l->len && "index b out of bounds"); \
+  type* data = name##_data(l); \
+  type tmp = data[a]; \
+  data[a] = data[b]; \
+  data[b] = tmp; \
+} \
+ \
+type name##_remove_swap(name* l, isize i) { \
+  assert(i < l->len && "access out of bounds"); \
+  type* data = name##_data(l); \
+  l->len--; \
+  type res = data[i]; \
+  data[i] = data[l->len]; \
+  return res; \
+} \
+ \
+void name##_append_array(name* l, const type* arr, isize arr_len) { \
+  name##_reserve(l, l->len + arr_len); \
+  memcpy(l->data + l->len, arr, arr_len * sizeof(type)); \
+  l->len += arr_len; \
+} \
+ \
+name name##_from_array(const type* arr, isize arr_len) { \
+  name res = {0}; \
+  name##_append_array(&res, arr, arr_len); \
+  return res; \
+} \
+ \
+void name##_append(name* this, name other) { \
+  name##_append_array(this, (const type*) name##_data(&other), other.len); \
+} \
+ \
+name name##_clone(name l) { \
+  name res = { .alloc = l.alloc }; \
+  name##_append_array(&res, (const type*) name##_data(&l), l.len); \
+  return res; \
 } \
  \
 void name##_free(name* l) { \
-  free(l->data); \
+  if (l->cap > (N)) allocator_free(l->alloc, l->data, sizeof(type) * l->cap); \
   l->cap = 0; \
   l->len = 0; \
   l->data = NULL; \
@@ -150,14 +348,366 @@ void name##_free(name* l) { \
 
 ////////////////////////////////
 
+/*
+  Structure of arrays list: https://en.wikipedia.org/wiki/AoS_and_SoA
+  Fields are passed as an X macro, each field gets its own contiguous array,
+  so loops touching a single field only bring that field in cache, and can be vectorized.
+
+  #define FILE_STAT_FIELDS(X) \
+    X(isize, size) \
+    X(u32, mode)
+  soa_list_def(FileStats, FILE_STAT_FIELDS)
+
+  FileStats is { len, cap, isize* size, u32* mode, alloc },
+  FileStatsElem is { isize size; u32 mode; }, used to push and get whole records.
+*/
+#define SOA_FIELD_ELEM(type, field) type field;
+#define SOA_FIELD_PTR(type, field) type* field;
+#define SOA_FIELD_REALLOC(type, field) \
+  l->field = allocator_realloc(l->alloc, l->field, sizeof(type) * old_cap, sizeof(type) * l->cap, _Alignof(type)); \
+  assert(l->field != NULL && "soa list realloc failed");
+#define SOA_FIELD_FREE(type, field) \
+  allocator_free(l->alloc, l->field, sizeof(type) * l->cap); \
+  l->field = NULL;
+#define SOA_FIELD_SET(type, field) l->field[i] = e.field;
+#define SOA_FIELD_GET(type, field) e.field = l->field[i];
+#define SOA_FIELD_SWAP(type, field) { type tmp = l->field[a]; l->field[a] = l->field[b]; l->field[b] = tmp; }
+#define SOA_FIELD_MOVE(type, field) l->field[dst] = l->field[src];
+
+#define soa_list_def(name, fields) \
+typedef struct { \
+  fields(SOA_FIELD_ELEM) \
+} name##Elem; \
+ \
+typedef struct { \
+  isize len, cap; \
+  fields(SOA_FIELD_PTR) \
+  const Allocator* alloc; \
+} name; \
+ \
+void name##_reserve(name* l, isize new_cap) { \
+  if (new_cap > l->cap) { \
+    isize old_cap = l->cap; \
+    l->cap = l->cap == 0 ? LIST_DEFAULT_CAP : l->cap; \
+    while (new_cap > l->cap) l->cap *= 2; \
+    fields(SOA_FIELD_REALLOC) \
+  } \
+} \
+ \
+void name##_set(name* l, isize i, name##Elem e) { \
+  assert(i < l->len && "access out of bounds"); \
+  fields(SOA_FIELD_SET) \
+} \
+ \
+name##Elem name##_get(const name* l, isize i) { \
+  assert(i < l->len && "access out of bounds"); \
+  name##Elem e; \
+  fields(SOA_FIELD_GET) \
+  return e; \
+} \
+ \
+void name##_push(name* l, name##Elem e) { \
+  name##_reserve(l, l->len + 1); \
+  isize i = l->len++; \
+  fields(SOA_FIELD_SET) \
+} \
+ \
+name##Elem name##_pop(name* l) { \
+  assert(l->len > 0 && "popped empty list"); \
+  name##Elem e = name##_get(l, l->len-1); \
+  l->len--; \
+  return e; \
+} \
+ \
+void name##_swap(name* l, isize a, isize b) { \
+  assert(a < l->len && "index a out of bounds"); \
+  assert(b < l->len && "index b out of bounds"); \
+  fields(SOA_FIELD_SWAP) \
+} \
+ \
+name##Elem name##_remove_swap(name* l, isize i) { \
+  name##Elem res = name##_get(l, i); \
+  isize dst = i, src = l->len - 1; \
+  fields(SOA_FIELD_MOVE) \
+  l->len--; \
+  return res; \
+} \
+ \
+void name##_free(name* l) { \
+  fields(SOA_FIELD_FREE) \
+  l->cap = 0; \
+  l->len = 0; \
+} \
+ \
+
+
+////////////////////////////////
+
+/*
+  Segmented list: elements are stored in chunks that never move.
+  Chunk k holds SEGLIST_FIRST_CAP << k elements, so capacity still grows geometrically,
+  but growing only allocates the next chunk: pointers to elements stay valid
+  for the whole life of the list, and the old elements are never copied.
+  Index i lives in chunk floor(log2(i + FIRST)) - log2(FIRST), found with a single clz.
+*/
+#define SEGLIST_FIRST_CAP_LOG2 4
+#define SEGLIST_FIRST_CAP (1 << SEGLIST_FIRST_CAP_LOG2)
+#define SEGLIST_MAX_CHUNKS (64 - SEGLIST_FIRST_CAP_LOG2)
+
+isize seglist_chunk_idx(isize i) {
+  return (63 - __builtin_clzll((u64) i + SEGLIST_FIRST_CAP)) - SEGLIST_FIRST_CAP_LOG2;
+}
+isize seglist_chunk_start(isize chunk) {
+  return ((isize) SEGLIST_FIRST_CAP << chunk) - SEGLIST_FIRST_CAP;
+}
+isize seglist_chunk_cap(isize chunk) {
+  return (isize) SEGLIST_FIRST_CAP << chunk;
+}
+
+#define seglist_def(type, name) \
+typedef struct { \
+  isize len, cap; \
+  isize chunks_len; \
+  type* chunks[SEGLIST_MAX_CHUNKS]; \
+  const Allocator* alloc; \
+} name; \
+ \
+void name##_reserve(name* l, isize new_cap) { \
+  while (new_cap > l->cap) { \
+    isize chunk_cap = seglist_chunk_cap(l->chunks_len); \
+    type* chunk = allocator_alloc(l->alloc, sizeof(type) * chunk_cap, _Alignof(type)); \
+    assert(chunk != NULL && "seglist chunk alloc failed"); \
+    l->chunks[l->chunks_len++] = chunk; \
+    l->cap += chunk_cap; \
+  } \
+} \
+ \
+type* name##_at(const name* l, isize i) { \
+  assert(i < l->len && "access out of bounds"); \
+  isize chunk = seglist_chunk_idx(i); \
+  return &l->chunks[chunk][i - seglist_chunk_start(chunk)]; \
+} \
+ \
+type* name##_push(name* l, type value) { \
+  name##_reserve(l, l->len + 1); \
+  l->len++; \
+  type* slot = name##_at(l, l->len-1); \
+  *slot = value; \
+  return slot; \
+} \
+ \
+type name##_pop(name* l) { \
+  assert(l->len > 0 && "popped empty list"); \
+  type res = *name##_at(l, l->len-1); \
+  l->len--; \
+  return res; \
+} \
+ \
+type* name##_last(const name* l) { \
+  assert(l->len > 0 && "access to empty list"); \
+  return name##_at(l, l->len-1); \
+} \
+ \
+/* returns the k-th chunk, and how many elements of it are used in len; iterate chunks up to chunks_len */ \
+type* name##_chunk(const name* l, isize k, isize* len) { \
+  isize start = seglist_chunk_start(k); \
+  isize used = l->len - start; \
+  isize cap = seglist_chunk_cap(k); \
+  *len = used <= 0 ? 0 : (used > cap ? cap : used); \
+  return l->chunks[k]; \
+} \
+ \
+void name##_append_array(name* l, const type* arr, isize arr_len) { \
+  name##_reserve(l, l->len + arr_len); \
+  while (arr_len > 0) { \
+    /* copy as much as fits in the chunk of the next free slot */ \
+    isize chunk = seglist_chunk_idx(l->len); \
+    isize offset = l->len - seglist_chunk_start(chunk); \
+    isize to_copy = seglist_chunk_cap(chunk) - offset; \
+    if (to_copy > arr_len) to_copy = arr_len; \
+    memcpy(l->chunks[chunk] + offset, arr, to_copy * sizeof(type)); \
+    l->len += to_copy; \
+    arr += to_copy; \
+    arr_len -= to_copy; \
+  } \
+} \
+ \
+void name##_free(name* l) { \
+  for (isize k=0; k<l->chunks_len; ++k) { \
+    allocator_free(l->alloc, l->chunks[k], sizeof(type) * seglist_chunk_cap(k)); \
+    l->chunks[k] = NULL; \
+  } \
+  l->chunks_len = 0; \
+  l->len = 0; \
+  l->cap = 0; \
+} \
+ \
+
+////////////////////////////////
+
+/*
+  Slot map: a dense list of values, for fast iteration, plus a sparse table of slots
+  mapping stable keys to dense positions. Removing swaps the last value in the hole,
+  and fixes its slot through dense_slots, so insert, remove and lookup are all O(1).
+  Slots count their generation: odd when occupied, bumped on every insert and remove,
+  so a key of a removed value never matches again, even after its slot is reused.
+  https://docs.rs/slotmap/latest/slotmap/
+*/
+typedef struct {
+  u32 idx;
+  u32 gen;
+} SlotKey;
+
+// gen is never 0 for an occupied slot, so the zero key is always invalid
+static const SlotKey SLOT_KEY_NONE = {0};
+
+typedef struct {
+  u32 gen;
+  // dense position when occupied, next free slot otherwise
+  u32 idx;
+} SlotMapSlot;
+
+bool slot_key_eq(SlotKey a, SlotKey b) {
+  return a.idx == b.idx && a.gen == b.gen;
+}
+
+#define slotmap_def(type, name) \
+typedef struct { \
+  isize len, cap; \
+  type* data; \
+  u32* dense_slots; \
+  SlotMapSlot* slots; \
+  isize slots_len, slots_cap; \
+  isize free_head; /* slots_len when no slot is free */ \
+  const Allocator* alloc; \
+} name; \
+ \
+void name##_reserve(name* m, isize new_cap) { \
+  if (new_cap <= m->cap) return; \
+  isize cap = m->cap == 0 ? LIST_DEFAULT_CAP : m->cap; \
+  while (new_cap > cap) cap *= 2; \
+  m->data = allocator_realloc(m->alloc, m->data, sizeof(type) * m->cap, sizeof(type) * cap, _Alignof(type)); \
+  m->dense_slots = allocator_realloc(m->alloc, m->dense_slots, sizeof(u32) * m->cap, sizeof(u32) * cap, _Alignof(u32)); \
+  assert(m->data != NULL && m->dense_slots != NULL && "slotmap realloc failed"); \
+  m->cap = cap; \
+} \
+ \
+SlotKey name##_insert(name* m, type value) { \
+  name##_reserve(m, m->len + 1); \
+  if (m->free_head == m->slots_len) { \
+    /* no free slot: add one */ \
+    assert(m->slots_len < UINT32_MAX && "slotmap full"); \
+    if (m->slots_len == m->slots_cap) { \
+      isize cap = m->slots_cap == 0 ? LIST_DEFAULT_CAP : m->slots_cap * 2; \
+      m->slots = allocator_realloc(m->alloc, m->slots, sizeof(SlotMapSlot) * m->slots_cap, sizeof(SlotMapSlot) * cap, _Alignof(SlotMapSlot)); \
+      assert(m->slots != NULL && "slotmap realloc failed"); \
+      m->slots_cap = cap; \
+    } \
+    m->slots[m->slots_len] = (SlotMapSlot) { 0, m->slots_len + 1 }; \
+    m->slots_len += 1; \
+  } \
+ \
+  u32 slot_idx = m->free_head; \
+  SlotMapSlot* slot = &m->slots[slot_idx]; \
+  m->free_head = slot->idx; \
+  slot->gen += 1; \
+  slot->idx = m->len; \
+ \
+  m->data[m->len] = value; \
+  m->dense_slots[m->len] = slot_idx; \
+  m->len += 1; \
+  return (SlotKey) { slot_idx, slot->gen }; \
+} \
+ \
+/* dense position of the value of key, or -1 if it was removed */ \
+isize name##_index_of(const name* m, SlotKey key) { \
+  if (key.idx >= m->slots_len) return -1; \
+  SlotMapSlot slot = m->slots[key.idx]; \
+  return slot.gen == key.gen && (slot.gen & 1) ? (isize) slot.idx : -1; \
+} \
+ \
+bool name##_contains(const name* m, SlotKey key) { \
+  return name##_index_of(m, key) >= 0; \
+} \
+ \
+/* NULL if the key was removed; the pointer is valid until the next insert or remove */ \
+type* name##_get(const name* m, SlotKey key) { \
+  isize i = name##_index_of(m, key); \
+  return i < 0 ? NULL : &m->data[i]; \
+} \
+ \
+/* key of the value at dense position i, to iterate data with keys */ \
+SlotKey name##_key_at(const name* m, isize i) { \
+  assert(i < m->len && "access out of bounds"); \
+  u32 slot_idx = m->dense_slots[i]; \
+  return (SlotKey) { slot_idx, m->slots[slot_idx].gen }; \
+} \
+ \
+/* returns false if the key was already removed; out may be NULL */ \
+bool name##_remove(name* m, SlotKey key, type* out) { \
+  isize i = name##_index_of(m, key); \
+  if (i < 0) return false; \
+  if (out != NULL) *out = m->data[i]; \
+ \
+  /* move the last value in the hole */ \
+  m->len -= 1; \
+  if (i != m->len) { \
+    m->data[i] = m->data[m->len]; \
+    m->dense_slots[i] = m->dense_slots[m->len]; \
+    m->slots[m->dense_slots[i]].idx = i; \
+  } \
+ \
+  SlotMapSlot* slot = &m->slots[key.idx]; \
+  slot->gen += 1; \
+  slot->idx = m->free_head; \
+  m->free_head = key.idx; \
+  return true; \
+} \
+ \
+/* removes all values; all keys become invalid */ \
+void name##_clear(name* m) { \
+  for (isize i=0; i<m->len; ++i) { \
+    u32 slot_idx = m->dense_slots[i]; \
+    m->slots[slot_idx].gen += 1; \
+    m->slots[slot_idx].idx = m->free_head; \
+    m->free_head = slot_idx; \
+  } \
+  m->len = 0; \
+} \
+ \
+void name##_free(name* m) { \
+  allocator_free(m->alloc, m->data, sizeof(type) * m->cap); \
+  allocator_free(m->alloc, m->dense_slots, sizeof(u32) * m->cap); \
+  allocator_free(m->alloc, m->slots, sizeof(SlotMapSlot) * m->slots_cap); \
+  *m = (name) { .alloc = m->alloc }; \
+} \
+ \
+
+////////////////////////////////
+
 
 #define list_def_alg(type, name) \
 name name##_shuffle(name* l) { \
   /* https://en.wikipedia.org/wiki/Fisher%E2%80%93Yates_shuffle */ \
-  srand(time(NULL)); \
+  Rng* rng = rand_thread_rng(); \
   for(isize i=l->len-1; i>0; --i) { \
-    isize r = rand() % (i+1); \
-    name##_swap(l, i, r); \
+    isize r = rng_bounded(rng, i+1); \
+    type tmp = l->data[i]; \
+    l->data[i] = l->data[r]; \
+    l->data[r] = tmp; \
+  } \
+  return *l; \
+} \
+ \
+/* partial shuffle: the first k elements become a uniform random sample, without repetitions */ \
+name name##_sample(name* l, isize k) { \
+  Rng* rng = rand_thread_rng(); \
+  if (k > l->len) k = l->len; \
+  for(isize i=0; i<k; ++i) { \
+    isize r = i + rng_bounded(rng, l->len - i); \
+    type tmp = l->data[i]; \
+    l->data[i] = l->data[r]; \
+    l->data[r] = tmp; \
   } \
   return *l; \
 } \
@@ -234,26 +784,214 @@ name name##_retain(name* l, name##EqFn pred) { \
   listfor(isize, i, l) { \
     const type* it = (const type*) &l->data[i]; \
     if (pred(it)) l->data[curr++] = l->data[i]; \
+    else if (name##_has_drop) name##_drop_elem(&l->data[i]); \
   } \
   l->len = curr; \
   return *l; \
 } \
+/* shallow copies the accepted elements, l keeps owning all of them */ \
 name name##_filter(const name* l, name##EqFn pred) { \
-  name res = name##_clone(*l); \
-  return name##_retain(&res, pred); \
+  name res = { .alloc = l->alloc }; \
+  listfor(isize, i, l) { \
+    const type* it = (const type*) &l->data[i]; \
+    if (pred(it)) name##_push(&res, l->data[i]); \
+  } \
+  return res; \
 } \
  \
 name name##_dedup(name* l, name##CmpFn pred) { \
+  if (l->len == 0) return *l; \
   if (!name##_is_sorted(l, pred)) name##_sort(l, pred); \
-  isize curr = 0; \
-  for (isize i=0; i<l->len-1; ++i) { \
-    const type* a = (const type*) &l->data[i]; \
-    const type* b = (const type*) &l->data[i+1]; \
-    if (pred(a, b) < 0) l->data[curr++] = l->data[i]; \
+  /* keep the first of each run of equal elements */ \
+  isize curr = 1; \
+  for (isize i=1; i<l->len; ++i) { \
+    const type* kept = (const type*) &l->data[curr-1]; \
+    const type* it = (const type*) &l->data[i]; \
+    if (pred(kept, it) != 0) l->data[curr++] = l->data[i]; \
+    else if (name##_has_drop) name##_drop_elem(&l->data[i]); \
   } \
   l->len = curr; \
   return *l; \
 } \
+/* open addressing set of element indexes, used by dedup_hash and unique_count */ \
+typedef u64 (*name##HashFn)(const type* val); \
+typedef struct { \
+  isize idx; \
+  u64 hash; \
+} name##HashSlot; \
+ \
+isize name##_hash_unique(name* l, name##HashFn hash, name##CmpFn pred, bool compact) { \
+  if (l->len == 0) return 0; \
+ \
+  /* keep the load factor under 1/2, linear probing stays short */ \
+  isize cap = LIST_DEFAULT_CAP; \
+  while (cap < 2 * l->len) cap *= 2; \
+  name##HashSlot* slots = malloc(cap * sizeof(name##HashSlot)); \
+  assert(slots != NULL && "dedup table alloc failed"); \
+  for (isize i=0; i<cap; ++i) slots[i].idx = -1; \
+ \
+  isize curr = 0; \
+  listfor(isize, i, l) { \
+    const type* val = (const type*) &l->data[i]; \
+    u64 h = hash != NULL ? hash(val) : list_hash_bytes(val, sizeof(type)); \
+    isize s = h & (cap - 1); \
+ \
+    bool found = false; \
+    for (; slots[s].idx != -1; s = (s + 1) & (cap - 1)) { \
+      if (slots[s].hash != h) continue; \
+      const type* other = (const type*) &l->data[slots[s].idx]; \
+      found = pred != NULL ? pred(val, other) == 0 : memcmp(val, other, sizeof(type)) == 0; \
+      if (found) break; \
+    } \
+    if (found) { \
+      if (compact && name##_has_drop) name##_drop_elem(&l->data[i]); \
+      continue; \
+    } \
+ \
+    /* when compacting, the first occurrence is moved to curr, which is always <= i */ \
+    slots[s].hash = h; \
+    slots[s].idx = compact ? curr : i; \
+    if (compact) l->data[curr] = l->data[i]; \
+    curr += 1; \
+  } \
+ \
+  free(slots); \
+  return curr; \
+} \
+ \
+name name##_dedup_hash(name* l, name##HashFn hash, name##CmpFn pred) { \
+  l->len = name##_hash_unique(l, hash, pred, true); \
+  return *l; \
+} \
+ \
+isize name##_unique_count(const name* l, name##HashFn hash, name##CmpFn pred) { \
+  /* not compacting, the list is left untouched */ \
+  return name##_hash_unique((name*) l, hash, pred, false); \
+} \
+ \
+/* sift down for a max heap (according to pred) of len elements, stored in data */ \
+void name##_heap_sift_down(type* data, isize len, isize root, name##CmpFn pred) { \
+  type val = data[root]; \
+  while (true) { \
+    isize child = 2*root + 1; \
+    if (child >= len) break; \
+    if (child+1 < len && pred((const type*) &data[child+1], (const type*) &data[child]) > 0) child += 1; \
+    if (pred((const type*) &data[child], (const type*) &val) <= 0) break; \
+    data[root] = data[child]; \
+    root = child; \
+  } \
+  data[root] = val; \
+} \
+ \
+/* moves the k smallest elements of data to the front, as a max heap; O(n log k) */ \
+void name##_heap_select(type* data, isize len, isize k, name##CmpFn pred) { \
+  for (isize i=k/2-1; i>=0; --i) name##_heap_sift_down(data, k, i, pred); \
+  for (isize i=k; i<len; ++i) { \
+    /* most elements are bigger than the heap top and only cost one comparison */ \
+    if (pred((const type*) &data[i], (const type*) &data[0]) >= 0) continue; \
+    type tmp = data[i]; \
+    data[i] = data[0]; \
+    data[0] = tmp; \
+    name##_heap_sift_down(data, k, 0, pred); \
+  } \
+} \
+ \
+void name##_insertion_sort(type* data, isize len, name##CmpFn pred) { \
+  for (isize i=1; i<len; ++i) { \
+    type val = data[i]; \
+    isize j = i; \
+    for (; j > 0 && pred((const type*) &val, (const type*) &data[j-1]) < 0; --j) data[j] = data[j-1]; \
+    data[j] = val; \
+  } \
+} \
+ \
+/* \
+  Places at index n the element which would be there if l was sorted, \
+  all elements before it are smaller or equal, all elements after it bigger or equal. \
+  https://en.wikipedia.org/wiki/Introselect \
+  Quickselect with median of three, falling back to heap select if partitions go bad. \
+  Average complexity O(n), worst case O(n logn). Returns itself. \
+*/ \
+name name##_select_nth(name* l, isize n, name##CmpFn pred) { \
+  assert(n < l->len && "select index out of bounds"); \
+  type* data = l->data; \
+  isize lo = 0, hi = l->len-1; \
+  isize depth = 0; \
+  for (isize len = l->len; len > 1; len >>= 1) depth += 2; \
+ \
+  while (hi - lo > 16) { \
+    if (depth-- == 0) { \
+      /* n-lo+1 smallest of the range to the front, the biggest of them is the nth */ \
+      name##_heap_select(data + lo, hi-lo+1, n-lo+1, pred); \
+      type tmp = data[lo]; \
+      data[lo] = data[n]; \
+      data[n] = tmp; \
+      return *l; \
+    } \
+ \
+    isize mid = lo + (hi - lo) / 2; \
+    if (pred((const type*) &data[mid], (const type*) &data[lo]) < 0) { type t = data[mid]; data[mid] = data[lo]; data[lo] = t; } \
+    if (pred((const type*) &data[hi],  (const type*) &data[lo]) < 0) { type t = data[hi];  data[hi]  = data[lo]; data[lo] = t; } \
+    if (pred((const type*) &data[hi],  (const type*) &data[mid]) < 0) { type t = data[hi]; data[hi]  = data[mid]; data[mid] = t; } \
+    type pivot = data[mid]; \
+ \
+    /* https://en.wikipedia.org/wiki/Quicksort#Hoare_partition_scheme, copes well with many equal elements */ \
+    isize i = lo - 1, j = hi + 1; \
+    while (true) { \
+      do ++i; while (pred((const type*) &data[i], (const type*) &pivot) < 0); \
+      do --j; while (pred((const type*) &data[j], (const type*) &pivot) > 0); \
+      if (i >= j) break; \
+      type tmp = data[i]; \
+      data[i] = data[j]; \
+      data[j] = tmp; \
+    } \
+ \
+    if (n <= j) hi = j; \
+    else lo = j + 1; \
+  } \
+ \
+  name##_insertion_sort(data + lo, hi-lo+1, pred); \
+  return *l; \
+} \
+ \
+/* \
+  Sorts only the k smallest elements, and moves them to the front of l. \
+  The order of the other elements is unspecified. O(n log k). Returns itself. \
+*/ \
+name name##_partial_sort(name* l, isize k, name##CmpFn pred) { \
+  if (k > l->len) k = l->len; \
+  if (k <= 0) return *l; \
+ \
+  name##_heap_select(l->data, l->len, k, pred); \
+  /* heap sort the max heap in place */ \
+  for (isize end=k-1; end>0; --end) { \
+    type tmp = l->data[0]; \
+    l->data[0] = l->data[end]; \
+    l->data[end] = tmp; \
+    name##_heap_sift_down(l->data, end, 0, pred); \
+  } \
+  return *l; \
+} \
+ \
+/* \
+  Same as partial_sort, but picks the fastest strategy for k: \
+  a heap of k elements when k is small compared to the list, introselect and sort otherwise. \
+  For the k biggest elements, pass a reversed pred. Returns itself. \
+*/ \
+name name##_top_k(name* l, isize k, name##CmpFn pred) { \
+  if (k > l->len) k = l->len; \
+  if (k <= 0) return *l; \
+ \
+  if (k * LIST_TOP_K_HEAP_RATIO <= l->len) return name##_partial_sort(l, k, pred); \
+ \
+  if (k < l->len) name##_select_nth(l, k-1, pred); \
+  _Pragma("GCC diagnostic push") \
+  _Pragma("GCC diagnostic ignored \"-Wcast-function-type\"") \
+  qsort(l->data, k, sizeof(type), (int (*)(const void*, const void*)) pred); \
+  _Pragma("GCC diagnostic pop") \
+  return *l; \
+} \
+ \
 isize name##_bsearch(const name* l, type val, name##CmpFn pred) { \
   _Pragma("GCC diagnostic push") \
   _Pragma("GCC diagnostic ignored \"-Wcast-function-type\"") \
@@ -78,7 +78,7 @@ typedef struct { \
 typedef struct { \
   isize len, cap; \
   name##Entry* entries; \
- \
+  const Allocator* alloc; \
 } name; \
  \
 name name##_with_cap(isize cap) { \
@@ -93,9 +93,10 @@ name name##_with_cap(isize cap) { \
     cap++; \
   } \
  \
-  name##Entry* data = malloc(cap * sizeof(name##Entry)); \
-  assert(data != NULL && "list realloc failed"); \
-  return (name) { 0, cap, data }; \
+  name##Entry* data = allocator_alloc(NULL, cap * sizeof(name##Entry), _Alignof(name##Entry)); \
+  assert(data != NULL && "map realloc failed"); \
+  memset(data, 0, cap * sizeof(name##Entry)); \
+  return (name) { 0, cap, data, NULL }; \
 } \
 name##Entry* name##_search(const name* m, str key) { \
   isize i = map_hash_key(key, m->cap); \
@@ -112,26 +113,30 @@ name##Entry* name##_search(const name* m, str key) { \
   return NULL; \
 } \
  \
-bool name##_insert(name*, str, type); \
 void name##_reserve(name* m, isize new_cap) { \
   if (new_cap > m->cap) { \
     name new_map = {0}; \
     new_map.cap = m->cap == 0 ? MAP_DEFAULT_CAP : m->cap; \
     while (new_cap > new_map.cap) new_map.cap *= 2; \
  \
-    new_map.entries = calloc(new_map.cap, sizeof(name##Entry)); \
+    new_map.entries = allocator_alloc(m->alloc, new_map.cap * sizeof(name##Entry), _Alignof(name##Entry)); \
     assert(new_map.entries != NULL && "map realloc failed"); \
+    memset(new_map.entries, 0, new_map.cap * sizeof(name##Entry)); \
  \
-    /* rehash */ \
+    /* rehash; keys are already owned by the map, so they are moved and not cloned again */ \
     for(isize i=0; i<m->cap; ++i) { \
       name##Entry* e = &m->entries[i]; \
-      if (!map_key_is_marker(e->key)) { \
-        name##_insert(&new_map, e->key, e->val); \
+      if (map_key_is_marker(e->key)) continue; \
+ \
+      isize j = map_hash_key(e->key, new_map.cap); \
+      for (isize retries = 1; !map_key_is_empty(new_map.entries[j].key); ++retries) { \
+        j = map_next_hash(j, retries, new_map.cap); \
       } \
+      new_map.entries[j] = *e; \
     } \
  \
     /* drop old map */ \
-    free(m->entries); \
+    allocator_free(m->alloc, m->entries, m->cap * sizeof(name##Entry)); \
     /* len should stay the same */ \
     m->cap = new_map.cap; \
     m->entries = new_map.entries; \
@@ -167,11 +172,11 @@ bool name##_insert(name* m, str key, int val) { \
   e->val = val; \
  \
   if (map_key_is_empty(e->key)) { \
-    e->key = str_clone(key); \
+    e->key = str_clone_alloc(key, m->alloc); \
     m->len += 1; \
     return true; \
   } else if (map_key_is_removed(e->key)) { \
-    e->key = str_clone(key); \
+    e->key = str_clone_alloc(key, m->alloc); \
     return false; \
   } else { \
     return false; \
@@ -184,7 +189,7 @@ bool name##_remove(name* m, str key) { \
   if (e == NULL) { \
     return false; \
   } else { \
-    free((byte*) e->key.data); \
+    allocator_free(m->alloc, (byte*) e->key.data, e->key.len); \
     e->key.data = MAP_ENTRY_REMOVED; \
     e->key.len = 0; \
     m->len -= 1; \
@@ -198,13 +203,14 @@ void name##_clear(name* m) { \
   /* keys are owned, free them */ \
   for (int i=0; i<m->cap; ++i) { \
     str key = m->entries[i].key; \
-    if (!map_key_is_marker(key)) free((byte*) key.data); \
+    if (!map_key_is_marker(key)) allocator_free(m->alloc, (byte*) key.data, key.len); \
   } \
+  memset(m->entries, 0, m->cap * sizeof(name##Entry)); \
 } \
  \
 void name##_free(name* m) { \
   name##_clear(m); \
-  free(m->entries); \
+  allocator_free(m->alloc, m->entries, m->cap * sizeof(name##Entry)); \
   m->cap = 0; \
   m->entries = NULL; \
 } \
@@ -252,6 +258,7 @@ typedef struct {
   isize cap, len;
   str* keys;
   byte* bits;
+  const Allocator* alloc;
 } Set;
 
 struct SetBitIdx {
@@ -281,26 +288,35 @@ int Set_search(const Set* s, str key) {
   return -1;
 }
 
-bool Set_insert(Set*, str);
 void Set_reserve(Set* s, isize new_cap) {
   if (new_cap > s->cap) {
     Set new_set = {0};
     new_set.cap = s->cap == 0 ? 16 : s->cap;
     while (new_cap > new_set.cap) new_set.cap *= 2;
 
-    new_set.keys = calloc(new_set.cap, sizeof(str));
-    new_set.bits = calloc(new_set.cap / 8, sizeof(char));
+    new_set.keys = allocator_alloc(s->alloc, new_set.cap * sizeof(str), _Alignof(str));
+    new_set.bits = allocator_alloc(s->alloc, new_set.cap / 8, 1);
     assert(new_set.keys != NULL && new_set.bits != NULL && "set realloc failed");
+    memset(new_set.keys, 0, new_set.cap * sizeof(str));
+    memset(new_set.bits, 0, new_set.cap / 8);
 
-    /* rehash */
-    for(int i=0; i<s->cap; ++i) {
+    /* rehash; keys are already owned by the set, so they are moved and not cloned again */
+    for(isize i=0; i<s->cap; ++i) {
       str* key = &s->keys[i];
-      if (!map_key_is_empty(*key)) Set_insert(&new_set, *key);
+      if (map_key_is_marker(*key)) continue;
+
+      isize j = map_hash_key(*key, new_set.cap);
+      for (isize retries = 1; !map_key_is_empty(new_set.keys[j]); ++retries) {
+        j = map_next_hash(j, retries, new_set.cap);
+      }
+      new_set.keys[j] = *key;
+      struct SetBitIdx idx = Set_bit_idx(j);
+      new_set.bits[idx.byte_idx] |= (1 << idx.bit_idx);
     }
 
     /* drop old map */
-    free(s->keys);
-    free(s->bits);
+    allocator_free(s->alloc, s->keys, s->cap * sizeof(str));
+    allocator_free(s->alloc, s->bits, s->cap / 8);
     /* len should stay the same */
     s->cap = new_set.cap;
     s->keys = new_set.keys;
@@ -340,7 +356,7 @@ bool Set_insert(Set* s, str key) {
   // already inserted
   if (i == -1) return false;
 
-  s->keys[i] = str_clone(key);
+  s->keys[i] = str_clone_alloc(key, s->alloc);
   s->len += 1;
   struct SetBitIdx idx = Set_bit_idx(i);
   byte* byte = &s->bits[idx.byte_idx];
@@ -355,7 +371,7 @@ bool Set_remove(Set* s, str key) {
   if (i == -1) return false;
 
   str* fkey = &s->keys[i];
-  free((byte*) fkey->data);
+  allocator_free(s->alloc, (byte*) fkey->data, fkey->len);
   fkey->data = MAP_ENTRY_REMOVED;
   fkey->len = 0;
   s->len -= 1;
@@ -374,14 +390,16 @@ void Set_clear(Set* s) { \
 
   for (int i=0; i<s->cap; ++i) {
     str key = s->keys[i];
-    if (!map_key_is_marker(key)) free((byte*) key.data);
+    if (!map_key_is_marker(key)) allocator_free(s->alloc, (byte*) key.data, key.len);
   }
+  memset(s->keys, 0, s->cap * sizeof(str));
+  memset(s->bits, 0, s->cap / 8);
 }
 
 void Set_free(Set* s) {
   Set_clear(s);
-  free(s->keys);
-  free(s->bits);
+  allocator_free(s->alloc, s->keys, s->cap * sizeof(str));
+  allocator_free(s->alloc, s->bits, s->cap / 8);
   s->cap = 0;
   s->keys = NULL;
   s->bits = NULL;
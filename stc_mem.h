@@ -1,77 +1,428 @@
 #ifndef STC_MEM_IMPL
 #define STC_MEM_IMPL
 
+// strict ISO modes (-std=c11) hide mmap flags like MAP_ANONYMOUS, which VArena needs;
+// this only helps if no system header was included before
+#if !defined(_WIN32) && !defined(_DEFAULT_SOURCE)
+#define _DEFAULT_SOURCE
+#endif
+
+#include <stdlib.h>
+#include <string.h>
 #include "stc_defs.h"
 
 // https://nullprogram.com/blog/2023/09/27/
 // https://nullprogram.com/blog/2023/12/17/
 
+/*
+  Allocator interface, used by all containers to get their memory.
+  Containers hold a pointer to an Allocator; NULL (the zero initializer) means libc.
+  The sizes of the previous allocation are always passed back to realloc and free,
+  so allocators that don't keep headers (like arenas) can work with them.
+*/
+typedef struct {
+  void* (*alloc)(void* ctx, isize size, isize align);
+  void* (*realloc)(void* ctx, void* ptr, isize old_size, isize new_size, isize align);
+  void  (*free)(void* ctx, void* ptr, isize size);
+  void* ctx;
+} Allocator;
+
+void* allocator_alloc(const Allocator* a, isize size, isize align) {
+  if (a == NULL) return malloc(size);
+  return a->alloc(a->ctx, size, align);
+}
+
+void* allocator_realloc(const Allocator* a, void* ptr, isize old_size, isize new_size, isize align) {
+  if (a == NULL) return realloc(ptr, new_size);
+  return a->realloc(a->ctx, ptr, old_size, new_size, align);
+}
+
+void allocator_free(const Allocator* a, void* ptr, isize size) {
+  if (a == NULL) free(ptr);
+  else a->free(a->ctx, ptr, size);
+}
+
+/*
+  Opt-in allocation tracking: compile with -DSTC_TRACK_ALLOC.
+  Every allocator_*() call is recorded under a tag, its call site (file:line). Inside the
+  container macros that is the line of the list_def() (or map_def(), ...) which defined the type,
+  so each instantiated container gets its own row.
+  A table from live pointers to their size and site attributes frees to the site which allocated.
+  Global live and peak bytes only count libc memory (NULL allocator), so that the regions of an arena
+  aren't counted twice, once for the arena and once for the containers inside it.
+  Without STC_TRACK_ALLOC, none of this is compiled, and allocator_*() are plain functions.
+*/
+#ifdef STC_TRACK_ALLOC
+#include <stdio.h>
+#include <stdatomic.h>
+
+#define STC_STRINGIFY_IMPL(x) #x
+#define STC_STRINGIFY(x) STC_STRINGIFY_IMPL(x)
+#define STC_ALLOC_TAG __FILE__ ":" STC_STRINGIFY(__LINE__)
+
+// must be a power of two
+#define STC_TRACK_MAX_SITES 512
+
+typedef struct {
+  const char* tag;
+  isize allocs, reallocs, frees;
+  isize live_bytes, peak_bytes, total_bytes;
+  // bytes copied by reallocs that had to move the block: the cost of growing
+  isize moved_bytes;
+} AllocSite;
+
+typedef struct {
+  void* ptr;
+  isize size;
+  i32 site;
+  bool libc;
+} AllocRecord;
+
+static struct {
+  AllocSite sites[STC_TRACK_MAX_SITES];
+  isize sites_len;
+  // site of the last tag seen at each pointer hash, to skip hashing the string
+  const char* tag_cache[STC_TRACK_MAX_SITES];
+  i32 tag_cache_site[STC_TRACK_MAX_SITES];
+  // open addressing, linear probing, by pointer
+  AllocRecord* records;
+  isize records_len, records_cap;
+  isize live_bytes, peak_bytes;
+  atomic_flag lock;
+} alloc_tracker = { .lock = ATOMIC_FLAG_INIT };
+
+void alloc_track_lock() {
+  while (atomic_flag_test_and_set_explicit(&alloc_tracker.lock, memory_order_acquire)) {}
+}
+
+void alloc_track_unlock() {
+  atomic_flag_clear_explicit(&alloc_tracker.lock, memory_order_release);
+}
+
+isize alloc_track_ptr_hash(void* ptr, isize cap) {
+  return (((uptr) ptr >> 4) * 0x9e3779b97f4a7c15ull) & (cap - 1);
+}
+
+// FNV-1a
+isize alloc_track_tag_hash(const char* tag, isize cap) {
+  u64 h = 0xcbf29ce484222325ull;
+  for (; *tag != '\0'; ++tag) h = (h ^ (u8) *tag) * 0x100000001b3ull;
+  return h & (cap - 1);
+}
+
+AllocSite* alloc_track_site(const char* tag, i32* idx) {
+  isize c = alloc_track_ptr_hash((void*) tag, STC_TRACK_MAX_SITES);
+  if (alloc_tracker.tag_cache[c] == tag) {
+    *idx = alloc_tracker.tag_cache_site[c];
+    return &alloc_tracker.sites[*idx];
+  }
+
+  // the same literal is not always merged into one pointer (e.g. across translation units): key by contents
+  isize i = alloc_track_tag_hash(tag, STC_TRACK_MAX_SITES);
+  while (alloc_tracker.sites[i].tag != NULL && strcmp(alloc_tracker.sites[i].tag, tag) != 0) {
+    i = (i + 1) & (STC_TRACK_MAX_SITES - 1);
+  }
+  AllocSite* site = &alloc_tracker.sites[i];
+  if (site->tag == NULL) {
+    assert(alloc_tracker.sites_len < STC_TRACK_MAX_SITES - 1 && "too many allocation sites");
+    site->tag = tag;
+    alloc_tracker.sites_len += 1;
+  }
+  alloc_tracker.tag_cache[c] = tag;
+  alloc_tracker.tag_cache_site[c] = i;
+  *idx = i;
+  return site;
+}
+
+void alloc_track_add_live(AllocSite* site, isize size, bool libc) {
+  site->live_bytes += size;
+  if (site->live_bytes > site->peak_bytes) site->peak_bytes = site->live_bytes;
+  if (!libc) return;
+  alloc_tracker.live_bytes += size;
+  if (alloc_tracker.live_bytes > alloc_tracker.peak_bytes) alloc_tracker.peak_bytes = alloc_tracker.live_bytes;
+}
+
+void alloc_track_release(AllocRecord r) {
+  if (r.ptr == NULL) return;
+  AllocSite* site = &alloc_tracker.sites[r.site];
+  site->live_bytes -= r.size;
+  if (r.libc) alloc_tracker.live_bytes -= r.size;
+}
+
+void alloc_track_insert(AllocRecord r) {
+  if (alloc_tracker.records_len * 2 >= alloc_tracker.records_cap) {
+    // grow and rehash; the table itself is not tracked
+    isize old_cap = alloc_tracker.records_cap;
+    AllocRecord* old = alloc_tracker.records;
+    alloc_tracker.records_cap = old_cap == 0 ? 1024 : old_cap * 2;
+    alloc_tracker.records = calloc(alloc_tracker.records_cap, sizeof(AllocRecord));
+    assert(alloc_tracker.records != NULL && "alloc tracker table alloc failed");
+    alloc_tracker.records_len = 0;
+    for (isize i=0; i<old_cap; ++i) {
+      if (old[i].ptr != NULL) alloc_track_insert(old[i]);
+    }
+    free(old);
+  }
+
+  isize i = alloc_track_ptr_hash(r.ptr, alloc_tracker.records_cap);
+  while (alloc_tracker.records[i].ptr != NULL && alloc_tracker.records[i].ptr != r.ptr) {
+    i = (i + 1) & (alloc_tracker.records_cap - 1);
+  }
+  // ptr was freed without allocator_free() and reused: its old record is stale
+  if (alloc_tracker.records[i].ptr != NULL) alloc_track_release(alloc_tracker.records[i]);
+  else alloc_tracker.records_len += 1;
+  alloc_tracker.records[i] = r;
+}
+
+// removes the record of ptr, returning it; ptr is NULL if it wasn't tracked
+AllocRecord alloc_track_take(void* ptr) {
+  AllocRecord res = {0};
+  if (ptr == NULL || alloc_tracker.records_cap == 0) return res;
+  isize cap = alloc_tracker.records_cap;
+  isize i = alloc_track_ptr_hash(ptr, cap);
+  while (alloc_tracker.records[i].ptr != NULL && alloc_tracker.records[i].ptr != ptr) i = (i + 1) & (cap - 1);
+  if (alloc_tracker.records[i].ptr == NULL) return res;
+  res = alloc_tracker.records[i];
+
+  // backward shift deletion, so that probe sequences stay unbroken without tombstones
+  isize hole = i;
+  for (isize j = (i + 1) & (cap - 1); alloc_tracker.records[j].ptr != NULL; j = (j + 1) & (cap - 1)) {
+    isize home = alloc_track_ptr_hash(alloc_tracker.records[j].ptr, cap);
+    // move j in the hole if its home is not cyclically in (hole, j]
+    bool movable = hole <= j ? (home <= hole || home > j) : (home <= hole && home > j);
+    if (movable) {
+      alloc_tracker.records[hole] = alloc_tracker.records[j];
+      hole = j;
+    }
+  }
+  alloc_tracker.records[hole] = (AllocRecord) {0};
+  alloc_tracker.records_len -= 1;
+  return res;
+}
+
+void alloc_track_alloc(const char* tag, void* ptr, isize size, bool libc) {
+  if (ptr == NULL) return;
+  alloc_track_lock();
+  i32 idx;
+  AllocSite* site = alloc_track_site(tag, &idx);
+  site->allocs += 1;
+  site->total_bytes += size;
+  alloc_track_add_live(site, size, libc);
+  alloc_track_insert((AllocRecord) { ptr, size, idx, libc });
+  alloc_track_unlock();
+}
+
+void alloc_track_realloc(const char* tag, void* old_ptr, void* new_ptr, isize old_size, isize new_size, bool libc) {
+  if (new_ptr == NULL) return;
+  alloc_track_lock();
+  alloc_track_release(alloc_track_take(old_ptr));
+  i32 idx;
+  AllocSite* site = alloc_track_site(tag, &idx);
+  if (old_ptr == NULL) site->allocs += 1;
+  else site->reallocs += 1;
+  if (old_ptr != NULL && new_ptr != old_ptr) site->moved_bytes += old_size < new_size ? old_size : new_size;
+  if (new_size > old_size) site->total_bytes += new_size - old_size;
+  alloc_track_add_live(site, new_size, libc);
+  alloc_track_insert((AllocRecord) { new_ptr, new_size, idx, libc });
+  alloc_track_unlock();
+}
+
+// counted on the site which allocated ptr; frees of untracked pointers are ignored
+void alloc_track_free(void* ptr) {
+  if (ptr == NULL) return;
+  alloc_track_lock();
+  AllocRecord r = alloc_track_take(ptr);
+  if (r.ptr != NULL) alloc_tracker.sites[r.site].frees += 1;
+  alloc_track_release(r);
+  alloc_track_unlock();
+}
+
+isize alloc_track_copy_sites(AllocSite* out) {
+  isize len = 0;
+  for (isize i=0; i<STC_TRACK_MAX_SITES; ++i) {
+    if (alloc_tracker.sites[i].tag != NULL) out[len++] = alloc_tracker.sites[i];
+  }
+  return len;
+}
+
+// Copies the sites with any activity in out, returning how many; out must hold STC_TRACK_MAX_SITES.
+isize alloc_track_sites(AllocSite* out) {
+  alloc_track_lock();
+  isize len = alloc_track_copy_sites(out);
+  alloc_track_unlock();
+  return len;
+}
+
+int alloc_site_cmp_live(const void* a, const void* b) {
+  const AllocSite* x = a;
+  const AllocSite* y = b;
+  if (x->live_bytes != y->live_bytes) return x->live_bytes < y->live_bytes ? 1 : -1;
+  return x->peak_bytes < y->peak_bytes ? 1 : (x->peak_bytes > y->peak_bytes ? -1 : 0);
+}
+
+// Prints a row per site, by live bytes.
+void alloc_track_report(FILE* f) {
+  static AllocSite sites[STC_TRACK_MAX_SITES];
+  // one snapshot: the totals must agree with the sites
+  alloc_track_lock();
+  isize len = alloc_track_copy_sites(sites);
+  isize live_bytes = alloc_tracker.live_bytes;
+  isize peak_bytes = alloc_tracker.peak_bytes;
+  alloc_track_unlock();
+  qsort(sites, len, sizeof(AllocSite), alloc_site_cmp_live);
+
+  fprintf(f, "libc live: %ld bytes, peak: %ld bytes\n", live_bytes, peak_bytes);
+  fprintf(f, "%-32s %12s %12s %12s %8s %8s %8s %12s\n", "site", "live", "peak", "total", "allocs", "reallocs", "frees", "moved");
+  for (isize i=0; i<len; ++i) {
+    AllocSite* s = &sites[i];
+    fprintf(f, "%-32s %12ld %12ld %12ld %8ld %8ld %8ld %12ld\n",
+      s->tag, s->live_bytes, s->peak_bytes, s->total_bytes, s->allocs, s->reallocs, s->frees, s->moved_bytes);
+  }
+}
+#endif
+
+#ifdef STC_TRACK_ALLOC
+void* allocator_alloc_tracked(const Allocator* a, isize size, isize align, const char* tag) {
+  void* res = allocator_alloc(a, size, align);
+  alloc_track_alloc(tag, res, size, a == NULL);
+  return res;
+}
+
+void* allocator_realloc_tracked(const Allocator* a, void* ptr, isize old_size, isize new_size, isize align, const char* tag) {
+  void* res = allocator_realloc(a, ptr, old_size, new_size, align);
+  alloc_track_realloc(tag, ptr, res, old_size, new_size, a == NULL);
+  return res;
+}
+
+void allocator_free_tracked(const Allocator* a, void* ptr, isize size) {
+  alloc_track_free(ptr);
+  allocator_free(a, ptr, size);
+}
+
+// from here on, every call records its call site
+#define allocator_alloc(a, size, align) allocator_alloc_tracked((a), (size), (align), STC_ALLOC_TAG)
+#define allocator_realloc(a, ptr, old_size, new_size, align) allocator_realloc_tracked((a), (ptr), (old_size), (new_size), (align), STC_ALLOC_TAG)
+#define allocator_free(a, ptr, size) allocator_free_tracked((a), (ptr), (size))
+#endif
+
 static const isize REGION_DEFAULT_CAP = 4096;
+// regions double in size up to this, then stay at it (bigger allocations still get their own region)
+static const isize REGION_MAX_CAP = 1 << 26;
 
 struct Region {
   struct Region* next;
   isize cap, len;
   byte data[];
-}
+};
 
 struct Region* region_new(isize size_bytes) {
-  isize region_size = sizeof(Region) + sizeof(byte) * size_bytes;
-  struct Region* region = malloc(region_size);
+  isize region_size = sizeof(struct Region) + sizeof(byte) * size_bytes;
+  struct Region* region = allocator_alloc(NULL, region_size, _Alignof(struct Region));
 
   assert(region != NULL && "arena region alloc failed");
-  r->next = NULL;
-  r->len = r->cap = 0;
+  region->next = NULL;
+  region->len = 0;
+  region->cap = size_bytes;
   return region;
 }
 
+/*
+  Bump allocator over a chain of regions. Regions after curr are always empty:
+  clearing or restoring the arena keeps them around, to be reused by later allocations.
+*/
 typedef struct {
   struct Region* head;
   struct Region* curr;
 } Arena;
 
-// TODO: test this
+isize arena_padding(struct Region* r, isize align) {
+  return -(uptr) (r->data + r->len) & (align - 1);
+}
+
 void* arena_alloc_with_size_align(Arena* a, isize count, isize size, isize align) {
+  assert(align > 0 && (align & (align - 1)) == 0 && "arena alignment must be a power of two");
+  assert(count >= 0 && size >= 0 && (size == 0 || count <= PTRDIFF_MAX / size) && "arena allocation too big");
   isize bytes_to_alloc = count * size;
 
-  // arena not initialized
-  if (a->curr == NULL) {
-    isize cap = bytes_to_alloc > REGION_DEFAULT_CAP : bytes_to_alloc : REGION_DEFAULT_CAP;
-    a->head = a->curr = region_new(cap);
+  struct Region* curr = a->curr;
+  while (curr == NULL || curr->cap - curr->len - arena_padding(curr, align) < bytes_to_alloc) {
+    // the next region is empty: use it if big enough
+    if (curr != NULL && curr->next != NULL && curr->next->cap - arena_padding(curr->next, align) >= bytes_to_alloc) {
+      curr = curr->next;
+      continue;
+    }
+
+    // geometric growth; worst case padding, so that a fresh region always fits the allocation
+    isize region_cap = curr == NULL ? REGION_DEFAULT_CAP : curr->cap * 2;
+    if (region_cap > REGION_MAX_CAP) region_cap = REGION_MAX_CAP;
+    if (bytes_to_alloc + align > region_cap) region_cap = bytes_to_alloc + align;
+
+    struct Region* r = region_new(region_cap);
+    if (curr == NULL) {
+      a->head = r;
+    } else {
+      // keep the following empty regions for later
+      r->next = curr->next;
+      curr->next = r;
+    }
+    curr = r;
   }
 
-  isize padding = 0;
-  isize bytes_avaible = 0;
+  a->curr = curr;
+  isize padding = arena_padding(curr, align);
+  void* res = curr->data + curr->len + padding;
+  curr->len += padding + bytes_to_alloc;
+  return res;
+}
 
-  // iter while we have more regions
-  while(a->curr->next != NULL) {
-    struct Region* curr = a->curr;
-    padding = -(uptr) (curr->data + curr->len) & (align -1);
-    bytes_avaible = curr->cap - curr->len - padding;
+#define arena_alloc(a, count, type) arena_alloc_with_size_align((a), (count), sizeof(type), _Alignof(type))
 
-    // if we have enough bytes avaible, stop here
-    if (bytes_avaible > bytes_to_alloc) break;
-   
-    a->curr = a->curr->next;
-  }
+/*
+  Grows or shrinks an allocation. If ptr is the last allocation made, and there is room,
+  it is resized in place; otherwise a new block is allocated and old_size bytes copied.
+*/
+void* arena_realloc(Arena* a, void* ptr, isize old_size, isize new_size, isize align) {
+  if (ptr == NULL) return arena_alloc_with_size_align(a, 1, new_size, align);
 
-  // we might have reached last arena and still not have enough space, allocate a new region
-  if (bytes_avaible <= 0) {
-    isize cap = bytes_to_alloc > REGION_DEFAULT_CAP : bytes_to_alloc : REGION_DEFAULT_CAP;
-    a->curr->next = region_new(cap);
-    a->curr = a->curr->next;
+  struct Region* curr = a->curr;
+  bool is_last = curr != NULL && (byte*) ptr + old_size == curr->data + curr->len;
+  if (is_last && (byte*) ptr + new_size <= curr->data + curr->cap) {
+    curr->len += new_size - old_size;
+    return ptr;
   }
+  if (new_size <= old_size) return ptr;
 
-  // compute the alloc address
-  struct Region* curr = a->curr;
-  padding = -(uptr) (curr->data + curr->len) & (align -1);
-  bytes_avaible = curr->cap - curr->len - padding;
+  void* res = arena_alloc_with_size_align(a, 1, new_size, align);
+  memcpy(res, ptr, old_size);
+  return res;
+}
 
-  void* res = curr->data + curr->len + padding;
-  a->curr->len += padding + bytes_avaible;
-  return res; 
+// A point to go back to, freeing everything allocated after it.
+typedef struct {
+  struct Region* region;
+  isize len;
+} ArenaMark;
+
+ArenaMark arena_save(Arena* a) {
+  return (ArenaMark) { a->curr, a->curr == NULL ? 0 : a->curr->len };
 }
 
-#define arena_alloc(a, count, type) arena_alloc_with_size_align((a), (count), sizeof(type), _Alignof(type))
+void arena_restore(Arena* a, ArenaMark mark) {
+  if (a->curr == NULL) return;
+  // empty all regions filled after the mark, up to the current one
+  struct Region* r = mark.region == NULL ? a->head : mark.region->next;
+  while (r != NULL && r != a->curr->next) {
+    r->len = 0;
+    r = r->next;
+  }
+
+  if (mark.region == NULL) {
+    a->curr = a->head;
+  } else {
+    mark.region->len = mark.len;
+    a->curr = mark.region;
+  }
+}
 
 void arena_clear(Arena* a) {
   struct Region* r = a->head;
@@ -79,16 +430,462 @@ void arena_clear(Arena* a) {
     r->len = 0;
     r = r->next;
   }
+  a->curr = a->head;
 }
 
 void arena_free(Arena* a) {
   struct Region* r = a->head;
   while (r) {
-    strcut Region* curr = r;
+    struct Region* curr = r;
     r = r->next;
-    free(curr);
+    allocator_free(NULL, curr, sizeof(struct Region) + curr->cap);
   }
   a->head = a->curr = NULL;
 }
 
+/*
+  Per-thread scratch arenas, for temporary allocations.
+  https://www.rfleury.com/p/untangling-lifetimes-the-arena-allocator
+  A function taking an output arena passes it as conflict, so that its temporaries
+  don't end up in the same arena, freeing the output on scratch_end().
+*/
+#define ARENA_SCRATCH_COUNT 2
+static __thread Arena arena_scratch_pool[ARENA_SCRATCH_COUNT] = {0};
+
+typedef struct {
+  Arena* arena;
+  ArenaMark mark;
+} ArenaTemp;
+
+ArenaTemp scratch_begin(const Arena* conflict) {
+  for (int i=0; i<ARENA_SCRATCH_COUNT; ++i) {
+    Arena* a = &arena_scratch_pool[i];
+    if (a != conflict) return (ArenaTemp) { a, arena_save(a) };
+  }
+  assert(false && "no free scratch arena");
+  return (ArenaTemp) {0};
+}
+
+void scratch_end(ArenaTemp temp) {
+  arena_restore(temp.arena, temp.mark);
+}
+
+// frees the calling thread's scratch arenas
+void scratch_free() {
+  for (int i=0; i<ARENA_SCRATCH_COUNT; ++i) arena_free(&arena_scratch_pool[i]);
+}
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <unistd.h>
+
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+#ifndef MAP_NORESERVE
+#define MAP_NORESERVE 0
+#endif
+// a system header was included before this one, in a strict ISO mode (-std=c11)
+#ifndef MAP_ANONYMOUS
+#error "MAP_ANONYMOUS is hidden: define _DEFAULT_SOURCE before including system headers"
+#endif
+
+/*
+  Virtual memory arena: reserves a big contiguous range of address space up front (PROT_NONE,
+  costs no memory), and commits it in chunks as the arena grows. The buffer never moves,
+  so there is a single pointer bump on allocation, and the last allocation can always grow in place.
+  https://www.gingerbill.org/article/2019/02/01/memory-allocation-strategies-002/
+*/
+static const isize VARENA_COMMIT_CHUNK = 64 * 1024;
+#define VARENA_HUGE_PAGE (2 * 1024 * 1024)
+
+typedef struct {
+  byte* base;
+  isize reserved, committed, len;
+  // commit granularity
+  isize chunk;
+} VArena;
+
+isize varena_round_up(isize n, isize to) {
+  return (n + to - 1) / to * to;
+}
+
+/*
+  Reserves reserve_bytes of address space. With huge_pages, the range is aligned and committed
+  in 2 MiB chunks, and marked for transparent huge pages, which cuts TLB misses on big arenas.
+*/
+void varena_init(VArena* a, isize reserve_bytes, bool huge_pages) {
+  *a = (VArena) {0};
+  a->chunk = huge_pages ? VARENA_HUGE_PAGE : VARENA_COMMIT_CHUNK;
+  isize page = sysconf(_SC_PAGESIZE);
+  if (a->chunk < page) a->chunk = page;
+  a->reserved = varena_round_up(reserve_bytes, a->chunk);
+
+  // reserve an extra chunk, to align the base on it
+  isize map_size = a->reserved + (huge_pages ? a->chunk : 0);
+  byte* map = mmap(NULL, map_size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  assert(map != MAP_FAILED && "varena reserve failed");
+  if (!huge_pages) {
+    a->base = map;
+    return;
+  }
+
+  byte* base = (byte*) varena_round_up((uptr) map, a->chunk);
+  if (base > map) munmap(map, base - map);
+  byte* map_end = map + map_size;
+  if (map_end > base + a->reserved) munmap(base + a->reserved, map_end - (base + a->reserved));
+  a->base = base;
+#ifdef MADV_HUGEPAGE
+  madvise(a->base, a->reserved, MADV_HUGEPAGE);
+#endif
+}
+
+void varena_commit(VArena* a, isize bytes) {
+  if (bytes <= a->committed) return;
+  assert(bytes <= a->reserved && "varena out of reserved memory");
+  isize new_committed = varena_round_up(bytes, a->chunk);
+  if (new_committed > a->reserved) new_committed = a->reserved;
+  int res = mprotect(a->base + a->committed, new_committed - a->committed, PROT_READ | PROT_WRITE);
+  assert(res == 0 && "varena commit failed");
+  UNUSED(res);
+  a->committed = new_committed;
+}
+
+void* varena_alloc_with_size_align(VArena* a, isize count, isize size, isize align) {
+  assert(align > 0 && (align & (align - 1)) == 0 && "arena alignment must be a power of two");
+  assert(count >= 0 && size >= 0 && (size == 0 || count <= PTRDIFF_MAX / size) && "arena allocation too big");
+  isize start = a->len + (-(uptr) (a->base + a->len) & (align - 1));
+  isize end = start + count * size;
+  if (end > a->committed) varena_commit(a, end);
+  a->len = end;
+  return a->base + start;
+}
+
+#define varena_alloc(a, count, type) varena_alloc_with_size_align((a), (count), sizeof(type), _Alignof(type))
+
+// Like arena_realloc(); the last allocation always grows in place.
+void* varena_realloc(VArena* a, void* ptr, isize old_size, isize new_size, isize align) {
+  if (ptr == NULL) return varena_alloc_with_size_align(a, 1, new_size, align);
+
+  if ((byte*) ptr + old_size == a->base + a->len) {
+    isize end = (byte*) ptr - a->base + new_size;
+    if (end > a->committed) varena_commit(a, end);
+    a->len = end;
+    return ptr;
+  }
+  if (new_size <= old_size) return ptr;
+
+  void* res = varena_alloc_with_size_align(a, 1, new_size, align);
+  memcpy(res, ptr, old_size);
+  return res;
+}
+
+// checkpoints are just the used length
+isize varena_save(VArena* a) {
+  return a->len;
+}
+
+void varena_restore(VArena* a, isize mark) {
+  assert(mark <= a->len && "varena restoring a newer checkpoint");
+  a->len = mark;
+}
+
+/*
+  Frees all allocations. With release, the committed pages are also given back to the OS
+  (they stay committed, and are zero filled on the next touch).
+*/
+void varena_clear(VArena* a, bool release) {
+  a->len = 0;
+  if (!release || a->committed == 0) return;
+#ifdef MADV_DONTNEED
+  madvise(a->base, a->committed, MADV_DONTNEED);
+#else
+  // fresh anonymous pages in place of the old ones
+  void* res = mmap(a->base, a->committed, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+  assert(res != MAP_FAILED && "varena release failed");
+#endif
+}
+
+void varena_free(VArena* a) {
+  if (a->base != NULL) munmap(a->base, a->reserved);
+  *a = (VArena) {0};
+}
+#endif
+
+/*
+  Pool (slab) allocator, for many objects of the same size.
+  https://www.gingerbill.org/article/2019/02/16/memory-allocation-strategies-004/
+  Objects are carved from page sized slabs; freed objects are threaded in an intrusive free list,
+  through their first bytes, so both alloc and release are O(1), with no headers.
+  Slabs are only returned to libc by pool_free().
+*/
+static const isize POOL_SLAB_SIZE = 4096;
+// slabs hold at least this many objects, even for big objects
+static const isize POOL_SLAB_MIN_OBJS = 8;
+
+typedef struct PoolFree {
+  struct PoolFree* next;
+} PoolFree;
+
+typedef struct PoolSlab {
+  struct PoolSlab* next;
+} PoolSlab;
+
+typedef struct {
+  isize obj_size, obj_align, slab_size;
+  PoolSlab* slabs;
+  PoolFree* free_list;
+  // unused part of the newest slab
+  byte* bump;
+  byte* bump_end;
+  isize live;
+} Pool;
+
+void pool_init(Pool* p, isize obj_size, isize align) {
+  assert(align > 0 && (align & (align - 1)) == 0 && "pool alignment must be a power of two");
+  if (align < (isize) _Alignof(PoolFree)) align = _Alignof(PoolFree);
+  if (obj_size < (isize) sizeof(PoolFree)) obj_size = sizeof(PoolFree);
+  obj_size = (obj_size + align - 1) & ~(align - 1);
+
+  *p = (Pool) {0};
+  p->obj_size = obj_size;
+  p->obj_align = align;
+  p->slab_size = POOL_SLAB_SIZE;
+  isize min_size = sizeof(PoolSlab) + align + obj_size * POOL_SLAB_MIN_OBJS;
+  while (p->slab_size < min_size) p->slab_size *= 2;
+}
+
+#define pool_init_for(p, type) pool_init((p), sizeof(type), _Alignof(type))
+
+void pool_new_slab(Pool* p) {
+  PoolSlab* slab = allocator_alloc(NULL, p->slab_size, _Alignof(PoolSlab));
+  assert(slab != NULL && "pool slab alloc failed");
+  slab->next = p->slabs;
+  p->slabs = slab;
+
+  byte* start = (byte*) (slab + 1);
+  p->bump = start + (-(uptr) start & (p->obj_align - 1));
+  p->bump_end = (byte*) slab + p->slab_size;
+}
+
+void* pool_alloc(Pool* p) {
+  assert(p->obj_size > 0 && "pool not initialized");
+  p->live += 1;
+  if (p->free_list != NULL) {
+    PoolFree* res = p->free_list;
+    p->free_list = res->next;
+    return res;
+  }
+
+  if (p->bump_end - p->bump < p->obj_size) pool_new_slab(p);
+  void* res = p->bump;
+  p->bump += p->obj_size;
+  return res;
+}
+
+// gives obj back to the pool
+void pool_release(Pool* p, void* obj) {
+  if (obj == NULL) return;
+  PoolFree* f = obj;
+  f->next = p->free_list;
+  p->free_list = f;
+  p->live -= 1;
+}
+
+void pool_free(Pool* p) {
+  PoolSlab* slab = p->slabs;
+  while (slab != NULL) {
+    PoolSlab* next = slab->next;
+    allocator_free(NULL, slab, p->slab_size);
+    slab = next;
+  }
+  isize obj_size = p->obj_size, obj_align = p->obj_align, slab_size = p->slab_size;
+  *p = (Pool) {0};
+  p->obj_size = obj_size;
+  p->obj_align = obj_align;
+  p->slab_size = slab_size;
+}
+
+/*
+  Pool shared by many threads. Each thread keeps its own PoolCache, so that most allocations
+  and releases don't touch shared state; caches exchange whole batches of POOL_BATCH_LEN
+  free objects with a global depot, under a spin lock, and so take it once every batch.
+  https://www.usenix.org/legacy/event/usenix01/full_papers/bonwick/bonwick.pdf (magazines and depot)
+*/
+#include <stdatomic.h>
+
+#define POOL_BATCH_LEN 64
+
+typedef struct {
+  PoolFree* head;
+  isize len;
+} PoolBatch;
+
+typedef struct {
+  Pool pool;
+  PoolBatch* depot;
+  isize depot_len, depot_cap;
+  atomic_flag lock;
+} SharedPool;
+
+// One per thread and pool, zero initialized.
+typedef struct {
+  PoolFree* head;
+  isize len;
+} PoolCache;
+
+void shared_pool_init(SharedPool* p, isize obj_size, isize align) {
+  *p = (SharedPool) {0};
+  pool_init(&p->pool, obj_size, align);
+  atomic_flag_clear(&p->lock);
+}
+
+void shared_pool_lock(SharedPool* p) {
+  while (atomic_flag_test_and_set_explicit(&p->lock, memory_order_acquire)) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+  }
+}
+
+void shared_pool_unlock(SharedPool* p) {
+  atomic_flag_clear_explicit(&p->lock, memory_order_release);
+}
+
+// takes a batch from the depot, or carves a new one from the slabs
+void pool_cache_refill(SharedPool* p, PoolCache* c) {
+  shared_pool_lock(p);
+  if (p->depot_len > 0) {
+    PoolBatch b = p->depot[--p->depot_len];
+    c->head = b.head;
+    c->len = b.len;
+  } else {
+    for (int i=0; i<POOL_BATCH_LEN; ++i) {
+      PoolFree* f = pool_alloc(&p->pool);
+      f->next = c->head;
+      c->head = f;
+    }
+    c->len = POOL_BATCH_LEN;
+  }
+  shared_pool_unlock(p);
+}
+
+void pool_depot_push(SharedPool* p, PoolBatch b) {
+  shared_pool_lock(p);
+  if (p->depot_len == p->depot_cap) {
+    isize cap = p->depot_cap == 0 ? 16 : p->depot_cap * 2;
+    p->depot = allocator_realloc(NULL, p->depot, sizeof(PoolBatch) * p->depot_cap, sizeof(PoolBatch) * cap, _Alignof(PoolBatch));
+    assert(p->depot != NULL && "pool depot realloc failed");
+    p->depot_cap = cap;
+  }
+  p->depot[p->depot_len++] = b;
+  shared_pool_unlock(p);
+}
+
+void* pool_cache_alloc(SharedPool* p, PoolCache* c) {
+  if (c->head == NULL) pool_cache_refill(p, c);
+  PoolFree* res = c->head;
+  c->head = res->next;
+  c->len -= 1;
+  return res;
+}
+
+// when the cache holds two batches, one goes back to the depot, for other threads
+void pool_cache_release(SharedPool* p, PoolCache* c, void* obj) {
+  if (obj == NULL) return;
+  PoolFree* f = obj;
+  f->next = c->head;
+  c->head = f;
+  c->len += 1;
+  if (c->len < 2 * POOL_BATCH_LEN) return;
+
+  PoolBatch b = { c->head, POOL_BATCH_LEN };
+  PoolFree* last = c->head;
+  for (int i=1; i<POOL_BATCH_LEN; ++i) last = last->next;
+  c->head = last->next;
+  c->len -= POOL_BATCH_LEN;
+  last->next = NULL;
+  pool_depot_push(p, b);
+}
+
+// gives all cached objects back to the depot; call before the thread exits
+void pool_cache_flush(SharedPool* p, PoolCache* c) {
+  if (c->head != NULL) pool_depot_push(p, (PoolBatch) { c->head, c->len });
+  *c = (PoolCache) {0};
+}
+
+// no thread should be using p anymore
+void shared_pool_free(SharedPool* p) {
+  pool_free(&p->pool);
+  allocator_free(NULL, p->depot, sizeof(PoolBatch) * p->depot_cap);
+  p->depot = NULL;
+  p->depot_len = p->depot_cap = 0;
+}
+
+static void* libc_alloc(void* ctx, isize size, isize align) {
+  UNUSED(ctx); UNUSED(align);
+  return malloc(size);
+}
+static void* libc_realloc(void* ctx, void* ptr, isize old_size, isize new_size, isize align) {
+  UNUSED(ctx); UNUSED(old_size); UNUSED(align);
+  return realloc(ptr, new_size);
+}
+static void libc_free(void* ctx, void* ptr, isize size) {
+  UNUSED(ctx); UNUSED(size);
+  free(ptr);
+}
+
+static const Allocator ALLOCATOR_LIBC = { libc_alloc, libc_realloc, libc_free, NULL };
+
+static void* arena_alloc_fn(void* ctx, isize size, isize align) {
+  return arena_alloc_with_size_align(ctx, 1, size, align);
+}
+static void* arena_realloc_fn(void* ctx, void* ptr, isize old_size, isize new_size, isize align) {
+  return arena_realloc(ctx, ptr, old_size, new_size, align);
+}
+static void arena_free_fn(void* ctx, void* ptr, isize size) {
+  /* arena memory is only released all at once, by arena_clear() or arena_free() */
+  UNUSED(ctx); UNUSED(ptr); UNUSED(size);
+}
+
+// The returned allocator points to a, which has to outlive all containers using it.
+Allocator arena_allocator(Arena* a) {
+  return (Allocator) { arena_alloc_fn, arena_realloc_fn, arena_free_fn, a };
+}
+
+static void* pool_alloc_fn(void* ctx, isize size, isize align) {
+  Pool* p = ctx;
+  assert(size <= p->obj_size && align <= p->obj_align && "allocation doesn't fit in pool objects");
+  UNUSED(size); UNUSED(align);
+  return pool_alloc(p);
+}
+static void* pool_realloc_fn(void* ctx, void* ptr, isize old_size, isize new_size, isize align) {
+  Pool* p = ctx;
+  assert(new_size <= p->obj_size && align <= p->obj_align && "allocation doesn't fit in pool objects");
+  UNUSED(old_size); UNUSED(new_size); UNUSED(align);
+  return ptr != NULL ? ptr : pool_alloc(p);
+}
+static void pool_free_fn(void* ctx, void* ptr, isize size) {
+  UNUSED(size);
+  pool_release(ctx, ptr);
+}
+
+// For containers of fixed size objects, like nodes: every allocation must fit in an object.
+Allocator pool_allocator(Pool* p) {
+  return (Allocator) { pool_alloc_fn, pool_realloc_fn, pool_free_fn, p };
+}
+
+#ifndef _WIN32
+static void* varena_alloc_fn(void* ctx, isize size, isize align) {
+  return varena_alloc_with_size_align(ctx, 1, size, align);
+}
+static void* varena_realloc_fn(void* ctx, void* ptr, isize old_size, isize new_size, isize align) {
+  return varena_realloc(ctx, ptr, old_size, new_size, align);
+}
+
+Allocator varena_allocator(VArena* a) {
+  return (Allocator) { varena_alloc_fn, varena_realloc_fn, arena_free_fn, a };
+}
+#endif
+
 #endif
\ No newline at end of file
@@ -0,0 +1,362 @@
+#ifndef STC_QUEUE_IMPL
+#define STC_QUEUE_IMPL
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <stdatomic.h>
+#include "stc_defs.h"
+#include "stc_mem.h"
+
+// Bounded concurrent queues.
+// Like Deque, capacity is a power of two, and positions are wrapped with a mask.
+// Positions only ever grow: the slot of a position is pos & (cap - 1), and len is tail - head.
+
+// Fields written by different threads are kept on different cache lines, to avoid false sharing.
+#define STC_CACHE_LINE 64
+
+// how many times blocking operations retry before going to sleep
+static const int QUEUE_SPIN_COUNT = 64;
+
+void queue_cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#endif
+}
+
+/*
+  Sleeping on a 32 bit word, until another thread changes it and wakes us.
+  https://man7.org/linux/man-pages/man2/futex.2.html
+  Without futexes (or with STC_QUEUE_NO_FUTEX), waiting threads just yield.
+*/
+#if defined(__linux__) && !defined(STC_QUEUE_NO_FUTEX)
+  #include <linux/futex.h>
+  #include <sys/syscall.h>
+  #include <unistd.h>
+
+void queue_futex_wait(_Atomic u32* addr, u32 expected) {
+  /* returns immediately if *addr != expected, so no wakeup can be lost */
+  syscall(SYS_futex, (u32*) addr, FUTEX_WAIT_PRIVATE, expected, NULL, NULL, 0);
+}
+
+void queue_futex_wake_all(_Atomic u32* addr) {
+  syscall(SYS_futex, (u32*) addr, FUTEX_WAKE_PRIVATE, __INT_MAX__, NULL, NULL, 0);
+}
+#else
+  #include <sched.h>
+
+void queue_futex_wait(_Atomic u32* addr, u32 expected) {
+  UNUSED(addr); UNUSED(expected);
+  sched_yield();
+}
+
+void queue_futex_wake_all(_Atomic u32* addr) {
+  UNUSED(addr);
+}
+#endif
+
+/*
+  Event to block on a condition, only paying for a syscall when someone is waiting.
+  Waiters read the epoch, register, recheck the condition, and sleep if the epoch didn't change.
+  Signalers change the condition, then bump the epoch and wake only if there are waiters.
+*/
+typedef struct {
+  _Atomic u32 epoch;
+  _Atomic u32 waiters;
+} QueueEvent;
+
+u32 queue_event_prepare(QueueEvent* e) {
+  u32 epoch = atomic_load(&e->epoch);
+  atomic_fetch_add(&e->waiters, 1);
+  /* the following recheck of the condition can't be ordered before the registration */
+  atomic_thread_fence(memory_order_seq_cst);
+  return epoch;
+}
+
+void queue_event_wait(QueueEvent* e, u32 epoch) {
+  queue_futex_wait(&e->epoch, epoch);
+  atomic_fetch_sub(&e->waiters, 1);
+}
+
+void queue_event_cancel(QueueEvent* e) {
+  atomic_fetch_sub(&e->waiters, 1);
+}
+
+void queue_event_signal(QueueEvent* e) {
+  /* pairs with the fence in prepare: either we see the waiter, or it sees our change */
+  atomic_thread_fence(memory_order_seq_cst);
+  if (atomic_load_explicit(&e->waiters, memory_order_relaxed) == 0) return;
+  atomic_fetch_add(&e->epoch, 1);
+  queue_futex_wake_all(&e->epoch);
+}
+
+/*
+  Single producer, single consumer queue.
+  https://rigtorp.se/ringbuffer/
+  Each side keeps a cached copy of the other side's index, and only reloads it
+  (an acquire load of a cache line owned by the other thread) when the queue looks full or empty.
+  Only one thread may push, and only one thread may pop.
+*/
+#define spsc_def(type, name) \
+typedef struct { \
+  /* written by the consumer */ \
+  _Alignas(STC_CACHE_LINE) _Atomic isize head; \
+  isize tail_cache; \
+  /* written by the producer */ \
+  _Alignas(STC_CACHE_LINE) _Atomic isize tail; \
+  isize head_cache; \
+  /* read only after init */ \
+  _Alignas(STC_CACHE_LINE) isize cap; \
+  type* data; \
+  const Allocator* alloc; \
+} name; \
+ \
+/* has to be called before any other thread uses q; cap is rounded up to a power of two */ \
+void name##_init(name* q, isize cap, const Allocator* alloc) { \
+  isize real_cap = 1; \
+  while (real_cap < cap) real_cap *= 2; \
+  atomic_init(&q->head, 0); \
+  atomic_init(&q->tail, 0); \
+  q->tail_cache = q->head_cache = 0; \
+  q->cap = real_cap; \
+  q->alloc = alloc; \
+  q->data = allocator_alloc(alloc, sizeof(type) * real_cap, _Alignof(type)); \
+  assert(q->data != NULL && "queue alloc failed"); \
+} \
+ \
+/* producer only; returns false if the queue is full */ \
+bool name##_push(name* q, type value) { \
+  isize tail = atomic_load_explicit(&q->tail, memory_order_relaxed); \
+  if (tail - q->head_cache >= q->cap) { \
+    q->head_cache = atomic_load_explicit(&q->head, memory_order_acquire); \
+    if (tail - q->head_cache >= q->cap) return false; \
+  } \
+  q->data[tail & (q->cap - 1)] = value; \
+  atomic_store_explicit(&q->tail, tail + 1, memory_order_release); \
+  return true; \
+} \
+ \
+/* consumer only; returns false if the queue is empty */ \
+bool name##_pop(name* q, type* out) { \
+  isize head = atomic_load_explicit(&q->head, memory_order_relaxed); \
+  if (head == q->tail_cache) { \
+    q->tail_cache = atomic_load_explicit(&q->tail, memory_order_acquire); \
+    if (head == q->tail_cache) return false; \
+  } \
+  *out = q->data[head & (q->cap - 1)]; \
+  atomic_store_explicit(&q->head, head + 1, memory_order_release); \
+  return true; \
+} \
+ \
+/* producer only; pushes as many elements of arr as fit, with one release. Returns how many */ \
+isize name##_push_array(name* q, const type* arr, isize arr_len) { \
+  isize tail = atomic_load_explicit(&q->tail, memory_order_relaxed); \
+  if (q->cap - (tail - q->head_cache) < arr_len) { \
+    q->head_cache = atomic_load_explicit(&q->head, memory_order_acquire); \
+  } \
+  isize n = q->cap - (tail - q->head_cache); \
+  if (n > arr_len) n = arr_len; \
+  if (n <= 0) return 0; \
+ \
+  isize start = tail & (q->cap - 1); \
+  isize first_len = q->cap - start < n ? q->cap - start : n; \
+  memcpy(q->data + start, arr, first_len * sizeof(type)); \
+  memcpy(q->data, arr + first_len, (n - first_len) * sizeof(type)); \
+  atomic_store_explicit(&q->tail, tail + n, memory_order_release); \
+  return n; \
+} \
+ \
+/* consumer only; pops up to n elements in out, with one release. Returns how many */ \
+isize name##_pop_array(name* q, type* out, isize n) { \
+  isize head = atomic_load_explicit(&q->head, memory_order_relaxed); \
+  if (q->tail_cache - head < n) { \
+    q->tail_cache = atomic_load_explicit(&q->tail, memory_order_acquire); \
+  } \
+  if (n > q->tail_cache - head) n = q->tail_cache - head; \
+  if (n <= 0) return 0; \
+ \
+  isize start = head & (q->cap - 1); \
+  isize first_len = q->cap - start < n ? q->cap - start : n; \
+  memcpy(out, q->data + start, first_len * sizeof(type)); \
+  memcpy(out + first_len, q->data, (n - first_len) * sizeof(type)); \
+  atomic_store_explicit(&q->head, head + n, memory_order_release); \
+  return n; \
+} \
+ \
+/* only a snapshot, may be stale as soon as it returns */ \
+isize name##_len(name* q) { \
+  return atomic_load_explicit(&q->tail, memory_order_acquire) - atomic_load_explicit(&q->head, memory_order_acquire); \
+} \
+ \
+/* no other thread should be using q anymore */ \
+void name##_free(name* q) { \
+  allocator_free(q->alloc, q->data, sizeof(type) * q->cap); \
+  q->data = NULL; \
+  q->cap = 0; \
+} \
+
+/*
+  Multi producer, multi consumer queue.
+  https://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+  Each cell has a sequence number, telling if it's ready to be written (seq == pos)
+  or read (seq == pos + 1) for the position which wraps on it.
+  Producers (and consumers) claim positions with a CAS on enqueue_pos (dequeue_pos),
+  so they only contend between themselves, and never take locks.
+  The blocking variants spin a bit, then sleep on a futex until the queue changes.
+*/
+#define mpmc_def(type, name) \
+typedef struct { \
+  _Atomic isize seq; \
+  type val; \
+} name##Cell; \
+ \
+typedef struct { \
+  _Alignas(STC_CACHE_LINE) _Atomic isize enqueue_pos; \
+  _Alignas(STC_CACHE_LINE) _Atomic isize dequeue_pos; \
+  _Alignas(STC_CACHE_LINE) QueueEvent not_empty; \
+  _Alignas(STC_CACHE_LINE) QueueEvent not_full; \
+  _Alignas(STC_CACHE_LINE) isize cap; \
+  name##Cell* cells; \
+  const Allocator* alloc; \
+} name; \
+ \
+/* has to be called before any other thread uses q; cap is rounded up to a power of two */ \
+void name##_init(name* q, isize cap, const Allocator* alloc) { \
+  isize real_cap = 2; \
+  while (real_cap < cap) real_cap *= 2; \
+  q->cap = real_cap; \
+  q->alloc = alloc; \
+  q->cells = allocator_alloc(alloc, sizeof(name##Cell) * real_cap, _Alignof(name##Cell)); \
+  assert(q->cells != NULL && "queue alloc failed"); \
+  for (isize i=0; i<real_cap; ++i) atomic_init(&q->cells[i].seq, i); \
+  atomic_init(&q->enqueue_pos, 0); \
+  atomic_init(&q->dequeue_pos, 0); \
+  q->not_empty = q->not_full = (QueueEvent) {0}; \
+} \
+ \
+/* \
+  Claims up to n consecutive positions, starting from *pos_var, whose cells have seq == pos + i + offset. \
+  offset is 0 for producers, 1 for consumers. Returns how many were claimed; 0 if full (or empty). \
+*/ \
+isize name##_claim(name* q, _Atomic isize* pos_var, isize* claimed_pos, isize n, isize offset) { \
+  isize pos = atomic_load_explicit(pos_var, memory_order_relaxed); \
+  while (true) { \
+    isize k = 0; \
+    for (; k < n; ++k) { \
+      name##Cell* cell = &q->cells[(pos + k) & (q->cap - 1)]; \
+      isize seq = atomic_load_explicit(&cell->seq, memory_order_acquire); \
+      if (seq != pos + k + offset) break; \
+    } \
+ \
+    if (k == 0) { \
+      name##Cell* cell = &q->cells[pos & (q->cap - 1)]; \
+      isize diff = atomic_load_explicit(&cell->seq, memory_order_acquire) - (pos + offset); \
+      /* the cell is still a lap behind: full (or empty) */ \
+      if (diff < 0) return 0; \
+      /* somebody else claimed pos already */ \
+      pos = atomic_load_explicit(pos_var, memory_order_relaxed); \
+      continue; \
+    } \
+ \
+    if (atomic_compare_exchange_weak_explicit(pos_var, &pos, pos + k, memory_order_relaxed, memory_order_relaxed)) { \
+      *claimed_pos = pos; \
+      return k; \
+    } \
+  } \
+} \
+ \
+/* pushes as many elements of arr as fit, up to arr_len; returns how many */ \
+isize name##_try_push_array(name* q, const type* arr, isize arr_len) { \
+  isize pos; \
+  isize k = name##_claim(q, &q->enqueue_pos, &pos, arr_len, 0); \
+  for (isize i=0; i<k; ++i) { \
+    name##Cell* cell = &q->cells[(pos + i) & (q->cap - 1)]; \
+    cell->val = arr[i]; \
+    atomic_store_explicit(&cell->seq, pos + i + 1, memory_order_release); \
+  } \
+  if (k > 0) queue_event_signal(&q->not_empty); \
+  return k; \
+} \
+ \
+/* pops up to n elements in out; returns how many */ \
+isize name##_try_pop_array(name* q, type* out, isize n) { \
+  isize pos; \
+  isize k = name##_claim(q, &q->dequeue_pos, &pos, n, 1); \
+  for (isize i=0; i<k; ++i) { \
+    name##Cell* cell = &q->cells[(pos + i) & (q->cap - 1)]; \
+    out[i] = cell->val; \
+    /* ready to be written again, one lap later */ \
+    atomic_store_explicit(&cell->seq, pos + i + q->cap, memory_order_release); \
+  } \
+  if (k > 0) queue_event_signal(&q->not_full); \
+  return k; \
+} \
+ \
+bool name##_try_push(name* q, type value) { \
+  return name##_try_push_array(q, &value, 1) == 1; \
+} \
+ \
+bool name##_try_pop(name* q, type* out) { \
+  return name##_try_pop_array(q, out, 1) == 1; \
+} \
+ \
+/* blocks until at least one element is pushed; returns how many */ \
+isize name##_push_array(name* q, const type* arr, isize arr_len) { \
+  while (true) { \
+    for (int i=0; i<QUEUE_SPIN_COUNT; ++i) { \
+      isize k = name##_try_push_array(q, arr, arr_len); \
+      if (k > 0) return k; \
+      queue_cpu_relax(); \
+    } \
+    u32 epoch = queue_event_prepare(&q->not_full); \
+    isize k = name##_try_push_array(q, arr, arr_len); \
+    if (k > 0) { \
+      queue_event_cancel(&q->not_full); \
+      return k; \
+    } \
+    queue_event_wait(&q->not_full, epoch); \
+  } \
+} \
+ \
+/* blocks until at least one element is popped; returns how many */ \
+isize name##_pop_array(name* q, type* out, isize n) { \
+  while (true) { \
+    for (int i=0; i<QUEUE_SPIN_COUNT; ++i) { \
+      isize k = name##_try_pop_array(q, out, n); \
+      if (k > 0) return k; \
+      queue_cpu_relax(); \
+    } \
+    u32 epoch = queue_event_prepare(&q->not_empty); \
+    isize k = name##_try_pop_array(q, out, n); \
+    if (k > 0) { \
+      queue_event_cancel(&q->not_empty); \
+      return k; \
+    } \
+    queue_event_wait(&q->not_empty, epoch); \
+  } \
+} \
+ \
+void name##_push(name* q, type value) { \
+  name##_push_array(q, &value, 1); \
+} \
+ \
+type name##_pop(name* q) { \
+  type res; \
+  name##_pop_array(q, &res, 1); \
+  return res; \
+} \
+ \
+/* only a snapshot, may be stale as soon as it returns */ \
+isize name##_len(name* q) { \
+  isize len = atomic_load(&q->enqueue_pos) - atomic_load(&q->dequeue_pos); \
+  return len < 0 ? 0 : len; \
+} \
+ \
+/* no other thread should be using q anymore */ \
+void name##_free(name* q) { \
+  allocator_free(q->alloc, q->cells, sizeof(name##Cell) * q->cap); \
+  q->cells = NULL; \
+  q->cap = 0; \
+} \
+
+#endif
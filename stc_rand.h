@@ -0,0 +1,131 @@
+#ifndef STC_RAND_IMPL
+#define STC_RAND_IMPL
+
+#include <string.h>
+#include <time.h>
+#include "stc_defs.h"
+
+// https://prng.di.unimi.it/
+// https://nullprogram.com/blog/2017/09/21/
+
+// xoshiro256** generator. Small, fast, and passes all statistical tests we care about.
+// Not cryptographically secure.
+typedef struct {
+  u64 s[4];
+} Rng;
+
+// https://prng.di.unimi.it/splitmix64.c
+// used to expand a single seed in the whole state
+u64 splitmix64(u64* x) {
+  u64 z = (*x += 0x9e3779b97f4a7c15);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+  return z ^ (z >> 31);
+}
+
+Rng rng_new(u64 seed) {
+  Rng r;
+  for (int i=0; i<4; ++i) r.s[i] = splitmix64(&seed);
+  return r;
+}
+
+u64 rng_rotl(u64 x, int k) {
+  return (x << k) | (x >> (64 - k));
+}
+
+u64 rng_next(Rng* r) {
+  u64* s = r->s;
+  u64 res = rng_rotl(s[1] * 5, 7) * 9;
+  u64 t = s[1] << 17;
+
+  s[2] ^= s[0];
+  s[3] ^= s[1];
+  s[1] ^= s[2];
+  s[0] ^= s[3];
+  s[2] ^= t;
+  s[3] = rng_rotl(s[3], 45);
+
+  return res;
+}
+
+// Unbiased integer in [0, range), without divisions in the common case.
+// https://arxiv.org/abs/1805.10941 (Lemire's method)
+u64 rng_bounded(Rng* r, u64 range) {
+  assert(range > 0 && "empty random range");
+  unsigned __int128 m = (unsigned __int128) rng_next(r) * range;
+  u64 low = (u64) m;
+  if (low < range) {
+    // only here we may be biased; reject the values of the short interval
+    u64 threshold = -range % range;
+    while (low < threshold) {
+      m = (unsigned __int128) rng_next(r) * range;
+      low = (u64) m;
+    }
+  }
+  return m >> 64;
+}
+
+// Integer in [lo, hi)
+i64 rng_range(Rng* r, i64 lo, i64 hi) {
+  assert(lo < hi && "empty random range");
+  return lo + (i64) rng_bounded(r, (u64) (hi - lo));
+}
+
+// Float in [0, 1), using the top 53 bits
+f64 rng_f64(Rng* r) {
+  return (rng_next(r) >> 11) * 0x1.0p-53;
+}
+
+void rng_fill(Rng* r, void* buf, isize len) {
+  byte* dst = buf;
+  for (; len >= 8; len -= 8, dst += 8) {
+    u64 x = rng_next(r);
+    memcpy(dst, &x, 8);
+  }
+  if (len > 0) {
+    u64 x = rng_next(r);
+    memcpy(dst, &x, len);
+  }
+}
+
+// Per-thread generator, used by the rand_ functions and list_shuffle().
+// Seeded from the clock on first use; call rand_seed() for reproducible runs.
+static __thread Rng rand_thread_state = {0};
+static __thread bool rand_thread_seeded = false;
+
+void rand_seed(u64 seed) {
+  rand_thread_state = rng_new(seed);
+  rand_thread_seeded = true;
+}
+
+Rng* rand_thread_rng() {
+  if (!rand_thread_seeded) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    // the address of the thread local state differs between threads
+    rand_seed(((u64) ts.tv_sec * 1000000000 + ts.tv_nsec) ^ (uptr) &rand_thread_state);
+  }
+  return &rand_thread_state;
+}
+
+u64 rand_u64() {
+  return rng_next(rand_thread_rng());
+}
+
+u64 rand_bounded(u64 range) {
+  return rng_bounded(rand_thread_rng(), range);
+}
+
+i64 rand_range(i64 lo, i64 hi) {
+  return rng_range(rand_thread_rng(), lo, hi);
+}
+
+f64 rand_f64() {
+  return rng_f64(rand_thread_rng());
+}
+
+void rand_fill(void* buf, isize len) {
+  rng_fill(rand_thread_rng(), buf, len);
+}
+
+#endif
@@ -68,16 +68,32 @@ list_def(char*, CstrList)
 char* str_to_cstr(str s) {
   char* res = malloc(s.len + 1);
   memcpy(res, s.data, s.len);
-  res[s.len + 1] = '\0';
+  res[s.len] = '\0';
   return res;
 }
 
+str str_clone_alloc(str s, const Allocator* a) {
+  char* cloned = allocator_alloc(a, s.len, 1);
+  memcpy(cloned, s.data, s.len);
+  return (str) { s.len, cloned };
+}
+
 str str_clone(str s) {
-  char* cloned = malloc(s.len);
+  return str_clone_alloc(s, NULL);
+}
+
+#ifdef STC_TRACK_ALLOC
+str str_clone_alloc_tagged(str s, const Allocator* a, const char* tag) {
+  char* cloned = allocator_alloc_tracked(a, s.len, 1, tag);
   memcpy(cloned, s.data, s.len);
   return (str) { s.len, cloned };
 }
 
+// clones are counted on the caller's site, like allocator_*()
+#define str_clone_alloc(s, a) str_clone_alloc_tagged((s), (a), STC_ALLOC_TAG)
+#define str_clone(s) str_clone_alloc_tagged((s), NULL, STC_ALLOC_TAG)
+#endif
+
 // TODO:  __builtin_constant_p might be useful
 str str_from_cstr(const char* s) {
   return (str) { strlen(s), s };
@@ -146,30 +162,482 @@ bool str_contains(str s, char c) {
   return str_find(s, c) != -1;
 }
 
-isize str_match(str s, str target) {
-  if (target.len > s.len) return -1;
-  str window = str_slice(s, 0, target.len);
+/*
+  Substring search.
+  The SIMD searchers compare blocks of the haystack against the first and the last byte of the
+  needle at once, and only verify the positions where both match.
+  http://0x80.pl/articles/simd-strfind.html
+  Needles whose first and last bytes are everywhere (like "aaab" in "aaaa...") would make this
+  O(n*m), so after too many failed verifications the search switches to Two-Way, which is O(n)
+  in the worst case, with constant extra space.
+  https://www-igm.univ-mlv.fr/~lecroq/string/node26.html
+  AVX2 is used when the cpu supports it, checked at runtime; define STC_NO_SIMD to use only the scalar code.
+  The ignorecase searches fold ASCII letters on the fly, in the same loops: a letter byte b matches
+  exactly the haystack bytes v with (v | 0x20) == (b | 0x20), so the prefilter stays exact.
+*/
+
+#if defined(__SSE2__) && !defined(STC_NO_SIMD)
+#define STC_STR_SIMD
+#include <immintrin.h>
+
+// ASCII uppercase letters of v to lowercase; the compares are signed, so bytes >= 0x80 are never in range
+__m128i str_lower_sse2(__m128i v) {
+  __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('A' - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8('Z' + 1)));
+  return _mm_xor_si128(v, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+}
+
+bool str_cpu_has_avx2() {
+  return __builtin_cpu_supports("avx2");
+}
+#endif
+
+u8 str_fold(u8 c) {
+  return c >= 'A' && c <= 'Z' ? c | 0x20 : c;
+}
+
+bool str_memeq_ignorecase(const char* a, const char* b, isize n) {
+  isize i = 0;
+#ifdef STC_STR_SIMD
+  for (; i + 16 <= n; i += 16) {
+    __m128i va = str_lower_sse2(_mm_loadu_si128((const __m128i*) (a + i)));
+    __m128i vb = str_lower_sse2(_mm_loadu_si128((const __m128i*) (b + i)));
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)) != 0xffff) return false;
+  }
+#endif
+  for (; i < n; ++i) {
+    if (str_fold(a[i]) != str_fold(b[i])) return false;
+  }
+  return true;
+}
 
-  for(isize i=0; i <= s.len - target.len; ++i) {
-    if (str_eq(window, target)) return i;
-    window.data += 1;
+// critical factorization of the needle: the maximal suffix, for the byte order or its reverse
+isize str_twoway_max_suffix(const u8* x, isize m, isize* period, bool reverse, bool fold) {
+  isize ms = -1, j = 0, k = 1, p = 1;
+  while (j + k < m) {
+    u8 a = fold ? str_fold(x[j + k]) : x[j + k];
+    u8 b = fold ? str_fold(x[ms + k]) : x[ms + k];
+    if (reverse ? a > b : a < b) {
+      j += k;
+      k = 1;
+      p = j - ms;
+    } else if (a == b) {
+      if (k != p) k += 1;
+      else {
+        j += p;
+        k = 1;
+      }
+    } else {
+      ms = j;
+      j = ms + 1;
+      k = p = 1;
+    }
   }
+  *period = p;
+  return ms;
+}
 
+// Two-Way preprocessing of a needle: the critical position and the period to shift by
+typedef struct {
+  isize ell, per;
+  bool periodic;
+  // compares ASCII case insensitively
+  bool fold;
+} StrTwoWay;
+
+StrTwoWay str_twoway_new(const char* needle, isize m, bool ignorecase) {
+  const u8* x = (const u8*) needle;
+  isize p, q;
+  isize i = str_twoway_max_suffix(x, m, &p, false, ignorecase);
+  isize j = str_twoway_max_suffix(x, m, &q, true, ignorecase);
+
+  StrTwoWay tw;
+  tw.fold = ignorecase;
+  tw.ell = i > j ? i : j;
+  tw.per = i > j ? p : q;
+  tw.periodic = ignorecase
+    ? str_memeq_ignorecase(needle, needle + tw.per, tw.ell + 1)
+    : memcmp(x, x + tw.per, tw.ell + 1) == 0;
+  if (!tw.periodic) tw.per = (tw.ell + 1 > m - tw.ell - 1 ? tw.ell + 1 : m - tw.ell - 1) + 1;
+  return tw;
+}
+
+// the search loops, comparing bytes through fold()
+#define STR_TWOWAY_SEARCH(fold) \
+  if (tw->periodic) { \
+    /* periodic needle: remember how much of the period already matched */ \
+    isize memory = -1; \
+    for (isize pos = 0; pos <= n - m;) { \
+      isize k = (ell > memory ? ell : memory) + 1; \
+      while (k < m && fold(x[k]) == fold(y[pos + k])) ++k; \
+      if (k < m) { \
+        pos += k - ell; \
+        memory = -1; \
+        continue; \
+      } \
+      k = ell; \
+      while (k > memory && fold(x[k]) == fold(y[pos + k])) --k; \
+      if (k <= memory) return pos; \
+      pos += per; \
+      memory = m - per - 1; \
+    } \
+  } else { \
+    for (isize pos = 0; pos <= n - m;) { \
+      isize k = ell + 1; \
+      while (k < m && fold(x[k]) == fold(y[pos + k])) ++k; \
+      if (k < m) { \
+        pos += k - ell; \
+        continue; \
+      } \
+      k = ell; \
+      while (k >= 0 && fold(x[k]) == fold(y[pos + k])) --k; \
+      if (k < 0) return pos; \
+      pos += per; \
+    } \
+  } \
   return -1;
+
+#define STR_NO_FOLD(c) (c)
+
+isize str_twoway_search(const StrTwoWay* tw, const char* hay, isize n, const char* needle, isize m) {
+  const u8* y = (const u8*) hay;
+  const u8* x = (const u8*) needle;
+  isize ell = tw->ell, per = tw->per;
+  if (m == 0) return 0;
+  if (m > n) return -1;
+
+  if (tw->fold) {
+    STR_TWOWAY_SEARCH(str_fold)
+  }
+  STR_TWOWAY_SEARCH(STR_NO_FOLD)
 }
 
+isize str_match_twoway(const char* hay, isize n, const char* needle, isize m) {
+  if (m == 0) return 0;
+  if (m > n) return -1;
+  StrTwoWay tw = str_twoway_new(needle, m, false);
+  return str_twoway_search(&tw, hay, n, needle, m);
+}
+
+// after this many failed verifications, and if they are more than one every STR_MATCH_FAIL_RATIO bytes, use Two-Way
+#define STR_MATCH_MIN_FAILS 64
+#define STR_MATCH_FAIL_RATIO 8
+
+bool str_match_too_many_fails(isize fails, isize scanned) {
+  return fails > STR_MATCH_MIN_FAILS && fails * STR_MATCH_FAIL_RATIO > scanned;
+}
+
+/*
+  The prefilters look for the positions where two bytes of the needle, at offsets r1 and r2, both match,
+  and verify only those. str_match() uses the first and the last byte; StrSearcher the two rarest ones.
+*/
+typedef struct {
+  const char* data;
+  isize len;
+  isize r1, r2;
+  bool fold;
+  // Two-Way fallback; computed when needed if NULL
+  const StrTwoWay* twoway;
+} StrNeedle;
+
+// the value to compare (v | mask) with, for the byte at offset r
+void str_needle_byte(const StrNeedle* nd, isize r, u8* value, u8* mask) {
+  u8 c = nd->data[r];
+  bool letter = nd->fold && (c_is_lower(c) || c_is_upper(c));
+  *value = letter ? c | 0x20 : c;
+  *mask = letter ? 0x20 : 0;
+}
+
+bool str_needle_eq(const StrNeedle* nd, const char* at) {
+  return nd->fold ? str_memeq_ignorecase(at, nd->data, nd->len) : memcmp(at, nd->data, nd->len) == 0;
+}
+
+// the rest of the haystack, from i, with Two-Way
+isize str_match_twoway_from(const StrNeedle* nd, const char* hay, isize n, isize i) {
+  if (nd->len > n - i) return -1;
+  StrTwoWay local;
+  const StrTwoWay* tw = nd->twoway;
+  if (tw == NULL) {
+    local = str_twoway_new(nd->data, nd->len, nd->fold);
+    tw = &local;
+  }
+  isize res = str_twoway_search(tw, hay + i, n - i, nd->data, nd->len);
+  return res < 0 ? -1 : i + res;
+}
+
+// checks the positions from i on, one at a time
+isize str_match_scalar_from(const StrNeedle* nd, const char* hay, isize n, isize i) {
+  isize m = nd->len, r1 = nd->r1, r2 = nd->r2;
+  u8 b1, mask1, b2, mask2;
+  str_needle_byte(nd, r1, &b1, &mask1);
+  str_needle_byte(nd, r2, &b2, &mask2);
+  isize fails = 0;
+  while (i <= n - m) {
+    if (mask1 == 0) {
+      const char* p = memchr(hay + i + r1, b1, n - m + 1 - i);
+      if (p == NULL) return -1;
+      i = p - hay - r1;
+    } else {
+      while (i <= n - m && ((u8) hay[i + r1] | mask1) != b1) ++i;
+      if (i > n - m) return -1;
+    }
+    if (((u8) hay[i + r2] | mask2) == b2 && str_needle_eq(nd, hay + i)) return i;
+    fails += 1;
+    i += 1;
+    if (str_match_too_many_fails(fails, i)) return str_match_twoway_from(nd, hay, n, i);
+  }
+  return -1;
+}
+
+#ifdef STC_STR_SIMD
+isize str_match_sse2(const StrNeedle* nd, const char* hay, isize n) {
+  isize m = nd->len;
+  u8 b1, mask1, b2, mask2;
+  str_needle_byte(nd, nd->r1, &b1, &mask1);
+  str_needle_byte(nd, nd->r2, &b2, &mask2);
+  __m128i vb1 = _mm_set1_epi8(b1), vmask1 = _mm_set1_epi8(mask1);
+  __m128i vb2 = _mm_set1_epi8(b2), vmask2 = _mm_set1_epi8(mask2);
+  isize fails = 0;
+  isize i = 0;
+  for (; i + m - 1 + 16 <= n; i += 16) {
+    __m128i a = _mm_or_si128(_mm_loadu_si128((const __m128i*) (hay + i + nd->r1)), vmask1);
+    __m128i b = _mm_or_si128(_mm_loadu_si128((const __m128i*) (hay + i + nd->r2)), vmask2);
+    u32 mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, vb1), _mm_cmpeq_epi8(b, vb2)));
+    while (mask != 0) {
+      int bit = __builtin_ctz(mask);
+      if (str_needle_eq(nd, hay + i + bit)) return i + bit;
+      fails += 1;
+      mask &= mask - 1;
+    }
+    if (str_match_too_many_fails(fails, i)) return str_match_twoway_from(nd, hay, n, i + 16);
+  }
+  return str_match_scalar_from(nd, hay, n, i);
+}
+
+__attribute__((target("avx2")))
+isize str_match_avx2(const StrNeedle* nd, const char* hay, isize n) {
+  isize m = nd->len;
+  u8 b1, mask1, b2, mask2;
+  str_needle_byte(nd, nd->r1, &b1, &mask1);
+  str_needle_byte(nd, nd->r2, &b2, &mask2);
+  __m256i vb1 = _mm256_set1_epi8(b1), vmask1 = _mm256_set1_epi8(mask1);
+  __m256i vb2 = _mm256_set1_epi8(b2), vmask2 = _mm256_set1_epi8(mask2);
+  isize fails = 0;
+  isize i = 0;
+  for (; i + m - 1 + 32 <= n; i += 32) {
+    __m256i a = _mm256_or_si256(_mm256_loadu_si256((const __m256i*) (hay + i + nd->r1)), vmask1);
+    __m256i b = _mm256_or_si256(_mm256_loadu_si256((const __m256i*) (hay + i + nd->r2)), vmask2);
+    u32 mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, vb1), _mm256_cmpeq_epi8(b, vb2)));
+    while (mask != 0) {
+      int bit = __builtin_ctz(mask);
+      if (str_needle_eq(nd, hay + i + bit)) return i + bit;
+      fails += 1;
+      mask &= mask - 1;
+    }
+    if (str_match_too_many_fails(fails, i)) return str_match_twoway_from(nd, hay, n, i + 32);
+  }
+  return str_match_scalar_from(nd, hay, n, i);
+}
+#endif
+
+isize str_match_prefilter(const StrNeedle* nd, const char* hay, isize n) {
+#ifdef STC_STR_SIMD
+  if (str_cpu_has_avx2()) return str_match_avx2(nd, hay, n);
+  return str_match_sse2(nd, hay, n);
+#else
+  return str_match_scalar_from(nd, hay, n, 0);
+#endif
+}
+
+// Index of the first occurrence of target in s, or -1. The empty target matches at 0.
+isize str_match(str s, str target) {
+  if (target.len == 0) return 0;
+  if (target.len > s.len) return -1;
+  if (target.len == 1) return str_find(s, target.data[0]);
+  StrNeedle nd = { target.data, target.len, 0, target.len - 1, false, NULL };
+  return str_match_prefilter(&nd, s.data, s.len);
+}
+
+// Like str_match(), comparing ASCII letters case insensitively.
+isize str_match_ignorecase(str s, str target) {
+  if (target.len == 0) return 0;
+  if (target.len > s.len) return -1;
+  StrNeedle nd = { target.data, target.len, 0, target.len - 1, true, NULL };
+  return str_match_prefilter(&nd, s.data, s.len);
+}
+
+// All the starting indexes of target in s, overlapping ones included.
 IntList str_match_all(str s, str target) {
   IntList matches = {0};
-  str window = str_slice(s, 0, target.len);
+  isize offset = 0;
+  while (offset <= s.len) {
+    isize i = str_match(str_slice(s, offset, s.len), target);
+    if (i == -1) break;
+    IntList_push(&matches, offset + i);
+    offset += i + 1;
+  }
+
+  return matches;
+}
+
+/*
+  A pattern compiled once, to be searched many times.
+  The strategy is chosen by pattern length and by how common its bytes are:
+  - single bytes use memchr
+  - the prefilter looks for the two rarest bytes of the pattern, with SIMD when available, else memchr
+    on the rarest one; the rarer the bytes, the fewer the candidates to verify
+  - long patterns made only of common bytes use Horspool, which skips up to the pattern length at a time
+  - short patterns of common bytes, without SIMD, use Two-Way
+  All of them fall back to Two-Way, precomputed here, when they verify too many false candidates.
+  Searchers made with str_searcher_new_ignorecase() compare ASCII letters case insensitively.
+*/
+
+typedef enum {
+  STR_SEARCH_EMPTY,
+  STR_SEARCH_BYTE,
+  STR_SEARCH_PREFILTER,
+  STR_SEARCH_HORSPOOL,
+  STR_SEARCH_TWOWAY,
+} StrSearchKind;
+
+typedef struct {
+  // not copied: should outlive the searcher
+  str pattern;
+  StrSearchKind kind;
+  bool ignorecase;
+  // offsets of the rarest bytes of the pattern
+  isize rare1, rare2;
+  StrTwoWay twoway;
+  // Horspool shifts, clamped to 255, which is always safe
+  u8 shift[256];
+} StrSearcher;
+
+// bytes this common or more don't make good prefilters
+#define STR_BYTE_COMMON 200
+// Horspool skips are worth it from this length
+#define STR_HORSPOOL_MIN_LEN 32
+
+// rough frequency of a byte in text and source code, 0 is rarest, 255 most common
+u8 str_byte_freq(u8 c) {
+  static const char letters[] = "etaoinsrhldcumfpgwybvkxjqz";
+  if (c == ' ') return 255;
+  if (c == '\n' || c == '\t') return 220;
+  const char* p = memchr(letters, c, sizeof(letters) - 1);
+  if (p != NULL) return 250 - (p - letters) * 4;
+  if (c_is_digit(c) || c_is_punct(c)) return 140;
+  if (c_is_upper(c)) return 120;
+  if (c >= 0x80) return 60;
+  return 20;
+}
+
+// a letter matching both cases is as common as its lowercase
+u8 str_search_freq(u8 c, bool ignorecase) {
+  return str_byte_freq(ignorecase ? str_fold(c) : c);
+}
+
+bool str_search_same(u8 a, u8 b, bool ignorecase) {
+  return ignorecase ? str_fold(a) == str_fold(b) : a == b;
+}
+
+StrSearcher str_searcher_init(str pattern, bool ignorecase) {
+  StrSearcher sr = {0};
+  sr.pattern = pattern;
+  sr.ignorecase = ignorecase;
+  isize m = pattern.len;
+  const u8* x = (const u8*) pattern.data;
+  if (m == 0) {
+    sr.kind = STR_SEARCH_EMPTY;
+    return sr;
+  }
+  if (m == 1 && !(ignorecase && (c_is_lower(x[0]) || c_is_upper(x[0])))) {
+    sr.kind = STR_SEARCH_BYTE;
+    return sr;
+  }
 
-  for (isize i=0; i <= s.len - target.len; ++i) {
-    if (str_eq(window, target)) {
-      IntList_push(&matches, i);
+  // the rarest byte, and the rarest one with a different value, or else at a different offset
+  sr.rare1 = 0;
+  for (isize i=1; i<m; ++i) {
+    if (str_search_freq(x[i], ignorecase) < str_search_freq(x[sr.rare1], ignorecase)) sr.rare1 = i;
+  }
+  sr.rare2 = sr.rare1 == m - 1 ? 0 : m - 1;
+  for (isize i=0; i<m; ++i) {
+    if (str_search_same(x[i], x[sr.rare1], ignorecase)) continue;
+    if (str_search_same(x[sr.rare2], x[sr.rare1], ignorecase) || str_search_freq(x[i], ignorecase) < str_search_freq(x[sr.rare2], ignorecase)) sr.rare2 = i;
+  }
+  bool common = str_search_freq(x[sr.rare1], ignorecase) >= STR_BYTE_COMMON;
+  sr.twoway = str_twoway_new(pattern.data, m, ignorecase);
+
+#ifdef STC_STR_SIMD
+  if (common && m >= STR_HORSPOOL_MIN_LEN) sr.kind = STR_SEARCH_HORSPOOL;
+  else sr.kind = STR_SEARCH_PREFILTER;
+#else
+  if (!common) sr.kind = STR_SEARCH_PREFILTER;
+  else if (m >= STR_HORSPOOL_MIN_LEN) sr.kind = STR_SEARCH_HORSPOOL;
+  else sr.kind = STR_SEARCH_TWOWAY;
+#endif
+
+  if (sr.kind == STR_SEARCH_HORSPOOL) {
+    u8 max_shift = m < 255 ? m : 255;
+    memset(sr.shift, max_shift, sizeof(sr.shift));
+    for (isize i=0; i<m-1; ++i) {
+      isize shift = m - 1 - i;
+      if (shift >= max_shift) continue;
+      sr.shift[x[i]] = shift;
+      if (ignorecase) {
+        sr.shift[(u8) c_to_lower(x[i])] = shift;
+        sr.shift[(u8) c_to_upper(x[i])] = shift;
+      }
     }
-    window.data += 1;
   }
+  return sr;
+}
 
-  return matches;
+StrSearcher str_searcher_new(str pattern) {
+  return str_searcher_init(pattern, false);
+}
+
+StrSearcher str_searcher_new_ignorecase(str pattern) {
+  return str_searcher_init(pattern, true);
+}
+
+StrNeedle str_searcher_needle(const StrSearcher* sr) {
+  return (StrNeedle) { sr->pattern.data, sr->pattern.len, sr->rare1, sr->rare2, sr->ignorecase, &sr->twoway };
+}
+
+isize str_searcher_horspool(const StrSearcher* sr, const char* hay, isize n) {
+  StrNeedle nd = str_searcher_needle(sr);
+  const char* x = sr->pattern.data;
+  isize m = sr->pattern.len;
+  u8 last = sr->ignorecase ? str_fold(x[m - 1]) : x[m - 1];
+  isize fails = 0;
+  for (isize pos = 0; pos <= n - m;) {
+    u8 c = hay[pos + m - 1];
+    if ((sr->ignorecase ? str_fold(c) : c) == last) {
+      bool eq = sr->ignorecase ? str_memeq_ignorecase(hay + pos, x, m - 1) : memcmp(hay + pos, x, m - 1) == 0;
+      if (eq) return pos;
+      fails += 1;
+      if (str_match_too_many_fails(fails, pos)) return str_match_twoway_from(&nd, hay, n, pos + 1);
+    }
+    pos += sr->shift[c];
+  }
+  return -1;
+}
+
+// Index of the first match of the searcher pattern in s, or -1.
+isize str_searcher_find(const StrSearcher* sr, str s) {
+  isize m = sr->pattern.len;
+  if (m > s.len) return -1;
+
+  StrNeedle nd;
+  switch (sr->kind) {
+    case STR_SEARCH_EMPTY: return 0;
+    case STR_SEARCH_BYTE: return str_find(s, sr->pattern.data[0]);
+    case STR_SEARCH_PREFILTER:
+      nd = str_searcher_needle(sr);
+      return str_match_prefilter(&nd, s.data, s.len);
+    case STR_SEARCH_HORSPOOL: return str_searcher_horspool(sr, s.data, s.len);
+    case STR_SEARCH_TWOWAY: return str_twoway_search(&sr->twoway, s.data, s.len, sr->pattern.data, m);
+  }
+  return -1;
 }
 
 
@@ -297,6 +765,10 @@ str str_trim(str s) {
 }
 
 list_def(str, StrList)
+// StrList holding its first elements inline, see list_def_small()
+#define SMALL_STRLIST_CAP 8
+list_def_small(str, SmallStrList, SMALL_STRLIST_CAP)
+
 StrList str_splitc_collect(str s, char c) {
   StrList ss = {0};
 
@@ -343,9 +815,152 @@ StrList str_split_when_collect(str s, CharPredicate pred) {
   return ss;
 }
 
-// TODO: does this work on windows? (line separator is "\r\n")
+//////////////////////
+
+/*
+  Bulk byte search: finds all the occurrences of a byte comparing 16 (SSE2) or 32 (AVX2) bytes
+  at a time, and writing their offsets in batches, instead of one memchr call per occurrence,
+  which is mostly call overhead when they are close together, like the newlines of short lines.
+*/
+
+list_def(isize, OffsetList)
+
+// the scalar tail: from *from until the end of s, or until out is full
+isize str_findc_batch_scalar(const char* s, isize n, char c, isize* from, isize* out, isize out_cap, isize out_len) {
+  isize i = *from;
+  for (; i < n && out_len < out_cap; ++i) {
+    if (s[i] == c) out[out_len++] = i;
+  }
+  *from = i;
+  return out_len;
+}
+
+#ifdef STC_STR_SIMD
+isize str_findc_batch_sse2(const char* s, isize n, char c, isize* from, isize* out, isize out_cap) {
+  __m128i vc = _mm_set1_epi8(c);
+  isize i = *from, len = 0;
+  // only whole blocks, while out has room for a whole block of matches
+  for (; i + 16 <= n && out_cap - len >= 16; i += 16) {
+    u32 mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*) (s + i)), vc));
+    while (mask != 0) {
+      out[len++] = i + __builtin_ctz(mask);
+      mask &= mask - 1;
+    }
+  }
+  *from = i;
+  // out is too full for a whole block: fill it a byte at a time, up to the next block, so *from always moves
+  if (i + 16 <= n) n = i + 16;
+  return str_findc_batch_scalar(s, n, c, from, out, out_cap, len);
+}
+
+__attribute__((target("avx2")))
+isize str_findc_batch_avx2(const char* s, isize n, char c, isize* from, isize* out, isize out_cap) {
+  __m256i vc = _mm256_set1_epi8(c);
+  isize i = *from, len = 0;
+  for (; i + 32 <= n && out_cap - len >= 32; i += 32) {
+    u32 mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*) (s + i)), vc));
+    while (mask != 0) {
+      out[len++] = i + __builtin_ctz(mask);
+      mask &= mask - 1;
+    }
+  }
+  *from = i;
+  if (i + 32 <= n) n = i + 32;
+  return str_findc_batch_scalar(s, n, c, from, out, out_cap, len);
+}
+#endif
+
+/*
+  Writes to out the offsets of c in s, starting from *from, until the end of s or until out is
+  (almost) full. Moves *from past the bytes searched, and returns how many offsets were written.
+  Always makes progress; an out_cap below STR_FINDC_BATCH_MIN works, but falls back to the scalar loop more often.
+*/
+#define STR_FINDC_BATCH_MIN 32
+
+isize str_findc_batch(str s, char c, isize* from, isize* out, isize out_cap) {
+  assert(out_cap > 0 && "out has no room");
+#ifdef STC_STR_SIMD
+  if (str_cpu_has_avx2()) return str_findc_batch_avx2(s.data, s.len, c, from, out, out_cap);
+  return str_findc_batch_sse2(s.data, s.len, c, from, out, out_cap);
+#else
+  return str_findc_batch_scalar(s.data, s.len, c, from, out, out_cap, 0);
+#endif
+}
+
+// Appends the offsets of all occurrences of c in s to out. Returns how many.
+isize str_findc_all(str s, char c, OffsetList* out) {
+  isize found = 0;
+  isize from = 0;
+  while (from < s.len) {
+    OffsetList_reserve(out, out->len + 1024);
+    isize n = str_findc_batch(s, c, &from, out->data + out->len, out->cap - out->len);
+    out->len += n;
+    found += n;
+  }
+  return found;
+}
+
+/*
+  Random access to the lines of a string, from the offsets of all its newlines, found in one pass.
+  Lines are split like str_lines(): a last empty line, after a final newline, is not counted.
+  With crlf, the '\r' before each '\n' is not part of the line.
+  Lines are indexed from 0.
+*/
+typedef struct {
+  str src;
+  OffsetList ends;
+  bool crlf;
+} LineIndex;
+
+LineIndex line_index_new(str s, bool crlf) {
+  LineIndex li = { s, {0}, crlf };
+  str_findc_all(s, '\n', &li.ends);
+  return li;
+}
+
+isize line_index_len(const LineIndex* li) {
+  isize last_start = li->ends.len == 0 ? 0 : li->ends.data[li->ends.len - 1] + 1;
+  return li->ends.len + (last_start < li->src.len ? 1 : 0);
+}
+
+// the line from start, ending at the newline at end, or at the end of s
+str str_line_at(str s, isize start, isize end, bool crlf) {
+  if (crlf && end < s.len && end > start && s.data[end - 1] == '\r') end -= 1;
+  return str_slice(s, start, end);
+}
+
+str line_index_get(const LineIndex* li, isize line) {
+  assert(line >= 0 && line < line_index_len(li) && "line index out of bounds");
+  isize start = line == 0 ? 0 : li->ends.data[line - 1] + 1;
+  isize end = line < li->ends.len ? li->ends.data[line] : li->src.len;
+  return str_line_at(li->src, start, end, li->crlf);
+}
+
+// The index of the line holding the byte at offset, with a binary search.
+isize line_index_line_of(const LineIndex* li, isize offset) {
+  // lines before offset: newlines strictly before it
+  isize lo = 0, hi = li->ends.len;
+  while (lo < hi) {
+    isize mid = lo + (hi - lo) / 2;
+    if (li->ends.data[mid] < offset) lo = mid + 1;
+    else hi = mid;
+  }
+  return lo;
+}
+
+void line_index_free(LineIndex* li) {
+  OffsetList_free(&li->ends);
+}
+
 StrList str_lines_collect(str s) {
-  return str_splitc_collect(s, '\n');
+  LineIndex li = line_index_new(s, false);
+  StrList ss = {0};
+  isize len = line_index_len(&li);
+  StrList_reserve(&ss, len);
+  for (isize i=0; i<len; ++i) ss.data[i] = line_index_get(&li, i);
+  ss.len = len;
+  line_index_free(&li);
+  return ss;
 }
 
 StrList str_words_collect(str s) {
@@ -395,6 +1010,35 @@ isize str_next_match(StrMatches* it) {
   return idx + last;
 }
 
+// Like StrMatches, with a precompiled searcher.
+typedef struct {
+  str src;
+  const StrSearcher* searcher;
+  // index in src of the next match, or -1
+  isize next;
+} StrSearcherMatches;
+
+StrSearcherMatches str_searcher_matches(str s, const StrSearcher* sr) {
+  return (StrSearcherMatches) { s, sr, str_searcher_find(sr, s) };
+}
+
+bool str_searcher_has_match(const StrSearcherMatches* it) {
+  return it->next != -1;
+}
+
+isize str_searcher_next_match(StrSearcherMatches* it) {
+  isize match = it->next;
+  if (match == -1) return -1;
+
+  isize from = match + 1;
+  if (from > it->src.len) it->next = -1;
+  else {
+    isize i = str_searcher_find(it->searcher, str_slice(it->src, from, it->src.len));
+    it->next = i == -1 ? -1 : from + i;
+  }
+  return match;
+}
+
 // TODO: this is clutter, consider removing it
 typedef struct {
   str src;
@@ -470,7 +1114,7 @@ str str_next_split_when(StrSplitWhen* it) {
   return res;
 }
 
-// TODO: does this work on windows? (line separator is "\r\n")
+// Lines end at '\n'; for "\r\n" line endings, see str_numbered_lines() or LineIndex.
 typedef StrSplitChar StrLines;
 StrLines str_lines(str s) {
   return str_splitc(s, '\n');
@@ -482,6 +1126,60 @@ str str_next_line(StrLines* it) {
   return str_next_splitc(it);
 }
 
+typedef struct {
+  str line;
+  // from 1
+  isize number;
+  // where the line starts in the source
+  isize offset;
+} StrLine;
+
+#define STR_LINES_BATCH 256
+
+/*
+  Like StrLines, also counting lines. Newlines are found in batches with str_findc_batch(),
+  so each call mostly just reads the next offset.
+  With crlf, the '\r' before each '\n' is not part of the line.
+*/
+typedef struct {
+  str src;
+  bool crlf;
+  // where the next line starts, and its number
+  isize start, number;
+  // how much of src was searched for newlines
+  isize scanned;
+  isize ends_idx, ends_len;
+  isize ends[STR_LINES_BATCH];
+} StrNumberedLines;
+
+StrNumberedLines str_numbered_lines(str s, bool crlf) {
+  StrNumberedLines it;
+  it.src = s;
+  it.crlf = crlf;
+  it.start = 0;
+  it.number = 1;
+  it.scanned = 0;
+  it.ends_idx = it.ends_len = 0;
+  return it;
+}
+
+bool str_has_numbered_line(const StrNumberedLines* it) {
+  return it->start < it->src.len;
+}
+
+StrLine str_next_numbered_line(StrNumberedLines* it) {
+  if (it->ends_idx == it->ends_len && it->scanned < it->src.len) {
+    it->ends_len = str_findc_batch(it->src, '\n', &it->scanned, it->ends, STR_LINES_BATCH);
+    it->ends_idx = 0;
+  }
+  isize end = it->ends_idx < it->ends_len ? it->ends[it->ends_idx++] : it->src.len;
+
+  StrLine res = { str_line_at(it->src, it->start, end, it->crlf), it->number, it->start };
+  it->start = end + 1;
+  it->number += 1;
+  return res;
+}
+
 typedef StrSplitWhen StrWords;
 StrWords str_words(str s) {
   return str_split_when(s, c_is_space);
@@ -557,6 +1255,26 @@ char* String_to_cstr(String sb) {
   return str_to_cstr(String_to_tmp_str(sb));
 }
 
+// String holding short strings inline, see list_def_small()
+// Does not allocate until it grows past SMALL_STRING_CAP chars.
+#define SMALL_STRING_CAP 24
+list_def_small(char, SmallString, SMALL_STRING_CAP)
+
+str SmallString_to_tmp_str(SmallString* sb) {
+  return (str) {
+    .len = sb->len,
+    .data = SmallString_data(sb),
+  };
+}
+
+void SmallString_append_str(SmallString* sb, str sv) {
+  SmallString_append_array(sb, sv.data, sv.len);
+}
+
+SmallString SmallString_from_str(str s) {
+  return SmallString_from_array(s.data, s.len);
+}
+
 static __thread String tmp_sb = {0};
 
 // TODO: read this
@@ -666,33 +1384,45 @@ String str_repeat(String* sb, str sv, isize n) {
 
 #define strforeach(c, s) listforeach(const char, c, s)
 
+// flips the case of the ASCII letters of src between lo and hi ('A' and 'Z', or 'a' and 'z'); dst may be src
+void str_flip_case(char* dst, const char* src, isize n, char lo, char hi) {
+  isize i = 0;
+#ifdef STC_STR_SIMD
+  __m128i vlo = _mm_set1_epi8(lo - 1), vhi = _mm_set1_epi8(hi + 1), flip = _mm_set1_epi8(0x20);
+  for (; i + 16 <= n; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i*) (src + i));
+    __m128i in_range = _mm_and_si128(_mm_cmpgt_epi8(v, vlo), _mm_cmplt_epi8(v, vhi));
+    _mm_storeu_si128((__m128i*) (dst + i), _mm_xor_si128(v, _mm_and_si128(in_range, flip)));
+  }
+#endif
+  for (; i < n; ++i) dst[i] = src[i] >= lo && src[i] <= hi ? src[i] ^ 0x20 : src[i];
+}
+
 // returns itself
 String str_to_upper(String* sb, str sv) {
-  sb->len = 0;
-  strforeach(c, &sv) {
-    String_push(sb, c_to_upper(*c));
-  }
+  String_reserve(sb, sv.len);
+  str_flip_case(sb->data, sv.data, sv.len, 'a', 'z');
+  sb->len = sv.len;
   return *sb;
 }
 
 // returns itself
 String str_to_lower(String* sb, str sv) {
-  sb->len = 0;
-  strforeach(c, &sv) {
-    String_push(sb, c_to_lower(*c));
-  }
+  String_reserve(sb, sv.len);
+  str_flip_case(sb->data, sv.data, sv.len, 'A', 'Z');
+  sb->len = sv.len;
   return *sb;
 }
 
 // returns itself
 String String_to_upper(String* s) {
-  listforeach(char, c, s) *c = c_to_upper(*c);
+  str_flip_case(s->data, s->data, s->len, 'a', 'z');
   return *s;
 }
 
 // returns itself
 String String_to_lower(String* s) {
-  listforeach(char, c, s) *c = c_to_lower(*c);
+  str_flip_case(s->data, s->data, s->len, 'A', 'Z');
   return *s;
 }
 
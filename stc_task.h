@@ -0,0 +1,330 @@
+#ifndef STC_TASK_IMPL
+#define STC_TASK_IMPL
+
+#include <stdlib.h>
+#include <assert.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "stc_defs.h"
+#include "stc_rand.h"
+#include "stc_queue.h"
+
+/*
+  Chase-Lev work stealing deque.
+  https://fzn.fr/readings/ppopp13.pdf (with the C11 memory orderings from the paper)
+  The owner thread pushes and pops at the bottom, like a stack, without any CAS
+  except when racing for the last element. Thieves steal from the top, with a CAS.
+  Like Deque, the buffer is a power of two ring indexed by ever growing positions.
+  When full, the owner copies it in a buffer twice as big; thieves may still be reading
+  the old one, so old buffers are only freed with the deque.
+*/
+typedef struct WsArray {
+  isize cap;
+  struct WsArray* prev;
+  _Atomic(void*) data[];
+} WsArray;
+
+typedef struct {
+  _Alignas(STC_CACHE_LINE) _Atomic isize top;
+  _Alignas(STC_CACHE_LINE) _Atomic isize bottom;
+  _Atomic(WsArray*) array;
+} WsDeque;
+
+static const isize WSDEQUE_DEFAULT_CAP = 256;
+
+WsArray* wsarray_new(isize cap, WsArray* prev) {
+  WsArray* a = malloc(sizeof(WsArray) + sizeof(void*) * cap);
+  assert(a != NULL && "wsdeque alloc failed");
+  a->cap = cap;
+  a->prev = prev;
+  return a;
+}
+
+void wsdeque_init(WsDeque* q) {
+  atomic_init(&q->top, 0);
+  atomic_init(&q->bottom, 0);
+  atomic_init(&q->array, wsarray_new(WSDEQUE_DEFAULT_CAP, NULL));
+}
+
+// owner only
+void wsdeque_push(WsDeque* q, void* val) {
+  isize b = atomic_load_explicit(&q->bottom, memory_order_relaxed);
+  isize t = atomic_load_explicit(&q->top, memory_order_acquire);
+  WsArray* a = atomic_load_explicit(&q->array, memory_order_relaxed);
+
+  if (b - t > a->cap - 1) {
+    WsArray* bigger = wsarray_new(a->cap * 2, a);
+    for (isize i=t; i<b; ++i) {
+      void* x = atomic_load_explicit(&a->data[i & (a->cap - 1)], memory_order_relaxed);
+      atomic_store_explicit(&bigger->data[i & (bigger->cap - 1)], x, memory_order_relaxed);
+    }
+    atomic_store_explicit(&q->array, bigger, memory_order_release);
+    a = bigger;
+  }
+
+  atomic_store_explicit(&a->data[b & (a->cap - 1)], val, memory_order_relaxed);
+  /* the paper uses a release fence and a relaxed store; this is equivalent, and sanitizers understand it */
+  atomic_store_explicit(&q->bottom, b + 1, memory_order_release);
+}
+
+// owner only; returns NULL if empty
+void* wsdeque_pop(WsDeque* q) {
+  isize b = atomic_load_explicit(&q->bottom, memory_order_relaxed) - 1;
+  WsArray* a = atomic_load_explicit(&q->array, memory_order_relaxed);
+  atomic_store_explicit(&q->bottom, b, memory_order_relaxed);
+  atomic_thread_fence(memory_order_seq_cst);
+  isize t = atomic_load_explicit(&q->top, memory_order_relaxed);
+
+  if (t > b) {
+    // empty
+    atomic_store_explicit(&q->bottom, b + 1, memory_order_relaxed);
+    return NULL;
+  }
+
+  void* x = atomic_load_explicit(&a->data[b & (a->cap - 1)], memory_order_relaxed);
+  if (t == b) {
+    // last element, race against thieves
+    if (!atomic_compare_exchange_strong_explicit(&q->top, &t, t + 1, memory_order_seq_cst, memory_order_relaxed)) {
+      x = NULL;
+    }
+    atomic_store_explicit(&q->bottom, b + 1, memory_order_relaxed);
+  }
+  return x;
+}
+
+// any thread; returns NULL if empty, or if another thread won the race
+void* wsdeque_steal(WsDeque* q) {
+  isize t = atomic_load_explicit(&q->top, memory_order_acquire);
+  atomic_thread_fence(memory_order_seq_cst);
+  isize b = atomic_load_explicit(&q->bottom, memory_order_acquire);
+  if (t >= b) return NULL;
+
+  WsArray* a = atomic_load_explicit(&q->array, memory_order_acquire);
+  void* x = atomic_load_explicit(&a->data[t & (a->cap - 1)], memory_order_relaxed);
+  if (!atomic_compare_exchange_strong_explicit(&q->top, &t, t + 1, memory_order_seq_cst, memory_order_relaxed)) {
+    return NULL;
+  }
+  return x;
+}
+
+// no other thread should be using q anymore
+void wsdeque_free(WsDeque* q) {
+  WsArray* a = atomic_load(&q->array);
+  while (a != NULL) {
+    WsArray* prev = a->prev;
+    free(a);
+    a = prev;
+  }
+  atomic_store(&q->array, NULL);
+}
+
+/////////////////////
+
+/*
+  Work stealing task scheduler.
+  Each worker owns a WsDeque: spawned tasks are pushed on the spawner's own deque,
+  idle workers steal from random victims. The thread calling scheduler_init() is worker 0,
+  and only helps running tasks while it waits in task_sync() or parallel_for().
+  Tasks can only be spawned from worker threads.
+*/
+
+typedef void (*TaskFn)(void* arg);
+
+// Counts the tasks spawned in the group which didn't finish yet.
+typedef struct {
+  _Atomic isize pending;
+} TaskGroup;
+
+typedef struct {
+  TaskFn fn;
+  void* arg;
+  TaskGroup* group;
+} Task;
+
+struct Scheduler;
+
+typedef struct {
+  WsDeque deque;
+  Rng rng;
+  isize id;
+  struct Scheduler* sched;
+} TaskWorker;
+
+typedef struct Scheduler {
+  isize workers_len;
+  TaskWorker* workers;
+  pthread_t* threads;
+  _Atomic bool stop;
+  // signaled whenever new tasks are pushed
+  QueueEvent work;
+} Scheduler;
+
+static __thread TaskWorker* task_curr_worker = NULL;
+
+// how many steal attempts an idle worker makes before going to sleep
+static const int TASK_STEAL_ROUNDS = 64;
+
+void task_run(Task* task) {
+  task->fn(task->arg);
+  atomic_fetch_sub_explicit(&task->group->pending, 1, memory_order_release);
+  free(task);
+}
+
+// pops from the own deque, or steals from another random worker
+Task* task_find(TaskWorker* w) {
+  Task* task = wsdeque_pop(&w->deque);
+  if (task != NULL) return task;
+
+  Scheduler* s = w->sched;
+  if (s->workers_len == 1) return NULL;
+  isize start = rng_bounded(&w->rng, s->workers_len);
+  for (isize i=0; i<s->workers_len; ++i) {
+    TaskWorker* victim = &s->workers[(start + i) % s->workers_len];
+    if (victim == w) continue;
+    task = wsdeque_steal(&victim->deque);
+    if (task != NULL) return task;
+  }
+  return NULL;
+}
+
+void* task_worker_loop(void* arg) {
+  TaskWorker* w = arg;
+  Scheduler* s = w->sched;
+  task_curr_worker = w;
+
+  while (!atomic_load_explicit(&s->stop, memory_order_acquire)) {
+    Task* task = NULL;
+    for (int i=0; i<TASK_STEAL_ROUNDS && task == NULL; ++i) {
+      task = task_find(w);
+      if (task == NULL) queue_cpu_relax();
+    }
+    if (task != NULL) {
+      task_run(task);
+      continue;
+    }
+
+    // nothing to do: sleep until some task is pushed
+    u32 epoch = queue_event_prepare(&s->work);
+    task = task_find(w);
+    if (task != NULL) {
+      queue_event_cancel(&s->work);
+      task_run(task);
+    } else if (atomic_load(&s->stop)) {
+      queue_event_cancel(&s->work);
+    } else {
+      queue_event_wait(&s->work, epoch);
+    }
+  }
+  return NULL;
+}
+
+// threads_count includes the calling thread; 0 uses one thread per online cpu
+void scheduler_init(Scheduler* s, isize threads_count) {
+  if (threads_count <= 0) threads_count = sysconf(_SC_NPROCESSORS_ONLN);
+  if (threads_count <= 0) threads_count = 1;
+
+  s->workers_len = threads_count;
+  s->workers = calloc(threads_count, sizeof(TaskWorker));
+  s->threads = calloc(threads_count, sizeof(pthread_t));
+  assert(s->workers != NULL && s->threads != NULL && "scheduler alloc failed");
+  atomic_init(&s->stop, false);
+  s->work = (QueueEvent) {0};
+
+  for (isize i=0; i<threads_count; ++i) {
+    TaskWorker* w = &s->workers[i];
+    wsdeque_init(&w->deque);
+    w->rng = rng_new(rand_u64());
+    w->id = i;
+    w->sched = s;
+  }
+
+  task_curr_worker = &s->workers[0];
+  for (isize i=1; i<threads_count; ++i) {
+    int res = pthread_create(&s->threads[i], NULL, task_worker_loop, &s->workers[i]);
+    assert(res == 0 && "scheduler thread creation failed");
+  }
+}
+
+// waits for all workers to finish; all task groups should have been synced
+void scheduler_free(Scheduler* s) {
+  atomic_store(&s->stop, true);
+  atomic_fetch_add(&s->work.epoch, 1);
+  queue_futex_wake_all(&s->work.epoch);
+  for (isize i=1; i<s->workers_len; ++i) pthread_join(s->threads[i], NULL);
+
+  if (task_curr_worker != NULL && task_curr_worker->sched == s) task_curr_worker = NULL;
+  for (isize i=0; i<s->workers_len; ++i) wsdeque_free(&s->workers[i].deque);
+  free(s->workers);
+  free(s->threads);
+  s->workers = NULL;
+  s->threads = NULL;
+  s->workers_len = 0;
+}
+
+void task_spawn(TaskGroup* g, TaskFn fn, void* arg) {
+  TaskWorker* w = task_curr_worker;
+  assert(w != NULL && "tasks can only be spawned from scheduler threads");
+
+  Task* task = malloc(sizeof(Task));
+  assert(task != NULL && "task alloc failed");
+  *task = (Task) { fn, arg, g };
+  atomic_fetch_add_explicit(&g->pending, 1, memory_order_relaxed);
+  wsdeque_push(&w->deque, task);
+  queue_event_signal(&w->sched->work);
+}
+
+// waits until all tasks of g are done, running tasks in the meantime
+void task_sync(TaskGroup* g) {
+  TaskWorker* w = task_curr_worker;
+  assert(w != NULL && "tasks can only be synced from scheduler threads");
+
+  while (atomic_load_explicit(&g->pending, memory_order_acquire) > 0) {
+    Task* task = task_find(w);
+    if (task != NULL) task_run(task);
+    else queue_cpu_relax();
+  }
+}
+
+/////////////////////
+
+typedef void (*RangeFn)(void* arg, isize begin, isize end);
+
+typedef struct {
+  RangeFn fn;
+  void* arg;
+  isize begin, end, grain;
+  TaskGroup* group;
+} TaskRange;
+
+// halves the range, spawning the right half, until it is small enough to run
+void task_range_run(void* arg) {
+  TaskRange* r = arg;
+  while (r->end - r->begin > r->grain) {
+    isize mid = r->begin + (r->end - r->begin) / 2;
+    TaskRange* right = malloc(sizeof(TaskRange));
+    assert(right != NULL && "task alloc failed");
+    *right = *r;
+    right->begin = mid;
+    r->end = mid;
+    task_spawn(r->group, task_range_run, right);
+  }
+  r->fn(r->arg, r->begin, r->end);
+  free(r);
+}
+
+// Calls fn on disjoint subranges of [begin, end), of at most grain elements, in parallel.
+// Returns when all of them are done.
+void parallel_for(isize begin, isize end, isize grain, RangeFn fn, void* arg) {
+  if (begin >= end) return;
+  if (grain < 1) grain = 1;
+
+  TaskGroup g = {0};
+  TaskRange* r = malloc(sizeof(TaskRange));
+  assert(r != NULL && "task alloc failed");
+  *r = (TaskRange) { fn, arg, begin, end, grain, &g };
+  task_spawn(&g, task_range_run, r);
+  task_sync(&g);
+}
+
+#endif
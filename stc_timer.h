@@ -0,0 +1,244 @@
+#ifndef STC_TIMER_IMPL
+#define STC_TIMER_IMPL
+
+#include <stdlib.h>
+#include <assert.h>
+#include "stc_defs.h"
+#include "stc_mem.h"
+
+/*
+  Hierarchical timing wheel.
+  http://www.cs.columbia.edu/~nahum/w6998/papers/ton97-timing-wheels.pdf
+  https://lwn.net/Articles/646950/
+  Level L has TIMER_SLOTS slots, each one TIMER_SLOTS^L ticks wide. Like Deque, slot counts are
+  a power of two, so the slot of a deadline is just (deadline >> shift) & mask.
+  A timer goes in the level of the highest bit where its deadline differs from now: when the clock
+  reaches the start of its slot, the slot is cascaded and its timers move to lower levels,
+  until they land in level 0 and fire. Scheduling and cancelling are O(1), and each timer is
+  cascaded at most once per level.
+  Timers are nodes of a pool, linked by index in the slots, with a free list for reuse.
+  With 64 slots, the non empty ones of a level fit in a u64 bitmap: advancing the clock
+  jumps straight to the next tick with something to cascade or fire.
+*/
+
+#define TIMER_SLOTS_BITS 6
+#define TIMER_SLOTS (1 << TIMER_SLOTS_BITS)
+#define TIMER_LEVELS 6
+
+// a generation in the high half, and the node index in the low half; 0 is never a valid id
+typedef u64 TimerId;
+
+typedef void (*TimerFn)(void* ctx, TimerId id, void* data);
+
+typedef struct {
+  u64 deadline;
+  void* data;
+  isize next, prev;
+  u32 gen;
+  bool active;
+  // where the node is linked
+  u8 level, slot;
+} TimerNode;
+
+typedef struct {
+  u64 now;
+  isize len;
+  // node pool
+  TimerNode* nodes;
+  isize nodes_len, nodes_cap;
+  isize free_head;
+  // first node of each slot, or -1
+  isize slots[TIMER_LEVELS][TIMER_SLOTS];
+  u64 occupied[TIMER_LEVELS];
+  const Allocator* alloc;
+} TimerWheel;
+
+void timer_wheel_init(TimerWheel* w, u64 now, const Allocator* alloc) {
+  *w = (TimerWheel) {0};
+  w->now = now;
+  w->free_head = -1;
+  w->alloc = alloc;
+  for (int l=0; l<TIMER_LEVELS; ++l) {
+    for (int s=0; s<TIMER_SLOTS; ++s) w->slots[l][s] = -1;
+  }
+}
+
+int timer_level_of(TimerWheel* w, u64 deadline) {
+  u64 diff = deadline ^ w->now;
+  int level = diff == 0 ? 0 : (63 - __builtin_clzll(diff)) / TIMER_SLOTS_BITS;
+  // too far in the future: parked in the top level, and cascaded again until in range
+  return level < TIMER_LEVELS ? level : TIMER_LEVELS - 1;
+}
+
+int timer_slot_idx(u64 tick, int level) {
+  return (tick >> (level * TIMER_SLOTS_BITS)) & (TIMER_SLOTS - 1);
+}
+
+void timer_link(TimerWheel* w, isize i) {
+  TimerNode* n = &w->nodes[i];
+  int level = timer_level_of(w, n->deadline);
+  int slot = timer_slot_idx(n->deadline, level);
+  isize* head = &w->slots[level][slot];
+  n->prev = -1;
+  n->next = *head;
+  if (*head >= 0) w->nodes[*head].prev = i;
+  *head = i;
+  w->occupied[level] |= (u64) 1 << slot;
+  n->level = level;
+  n->slot = slot;
+}
+
+void timer_unlink(TimerWheel* w, isize i) {
+  TimerNode* n = &w->nodes[i];
+  if (n->next >= 0) w->nodes[n->next].prev = n->prev;
+  if (n->prev >= 0) {
+    w->nodes[n->prev].next = n->next;
+    return;
+  }
+
+  w->slots[n->level][n->slot] = n->next;
+  if (n->next < 0) w->occupied[n->level] &= ~((u64) 1 << n->slot);
+}
+
+isize timer_node_alloc(TimerWheel* w) {
+  if (w->free_head >= 0) {
+    isize i = w->free_head;
+    w->free_head = w->nodes[i].next;
+    return i;
+  }
+
+  if (w->nodes_len == w->nodes_cap) {
+    isize cap = w->nodes_cap == 0 ? 64 : w->nodes_cap * 2;
+    w->nodes = allocator_realloc(w->alloc, w->nodes, sizeof(TimerNode) * w->nodes_cap, sizeof(TimerNode) * cap, _Alignof(TimerNode));
+    assert(w->nodes != NULL && "timer wheel realloc failed");
+    w->nodes_cap = cap;
+  }
+  w->nodes[w->nodes_len] = (TimerNode) { .gen = 0 };
+  return w->nodes_len++;
+}
+
+void timer_node_release(TimerWheel* w, isize i) {
+  TimerNode* n = &w->nodes[i];
+  n->active = false;
+  n->gen += 1;
+  n->next = w->free_head;
+  w->free_head = i;
+  w->len -= 1;
+}
+
+// Deadlines not after now fire on the next tick.
+TimerId timer_schedule(TimerWheel* w, u64 deadline, void* data) {
+  if (deadline <= w->now) deadline = w->now + 1;
+
+  isize i = timer_node_alloc(w);
+  TimerNode* n = &w->nodes[i];
+  n->deadline = deadline;
+  n->data = data;
+  n->active = true;
+  // generations start from 1, so that ids are never 0
+  if (n->gen == 0) n->gen = 1;
+  timer_link(w, i);
+  w->len += 1;
+  return ((u64) n->gen << 32) | (u64) i;
+}
+
+TimerId timer_schedule_after(TimerWheel* w, u64 ticks, void* data) {
+  return timer_schedule(w, w->now + ticks, data);
+}
+
+TimerNode* timer_get_node(TimerWheel* w, TimerId id) {
+  isize i = id & 0xffffffff;
+  u32 gen = id >> 32;
+  if (i >= w->nodes_len) return NULL;
+  TimerNode* n = &w->nodes[i];
+  if (!n->active || n->gen != gen) return NULL;
+  return n;
+}
+
+bool timer_is_pending(TimerWheel* w, TimerId id) {
+  return timer_get_node(w, id) != NULL;
+}
+
+// Returns false if the timer already fired, or was already cancelled.
+bool timer_cancel(TimerWheel* w, TimerId id) {
+  TimerNode* n = timer_get_node(w, id);
+  if (n == NULL) return false;
+  isize i = n - w->nodes;
+  timer_unlink(w, i);
+  timer_node_release(w, i);
+  return true;
+}
+
+// moves all timers of a slot to their slot for the current time, which is always in a lower level
+void timer_cascade(TimerWheel* w, int level) {
+  int slot = timer_slot_idx(w->now, level);
+  isize i = w->slots[level][slot];
+  w->slots[level][slot] = -1;
+  w->occupied[level] &= ~((u64) 1 << slot);
+  while (i >= 0) {
+    isize next = w->nodes[i].next;
+    timer_link(w, i);
+    i = next;
+  }
+}
+
+// the first tick after now where a non empty slot is cascaded or fired, or limit
+u64 timer_next_event(TimerWheel* w, u64 limit) {
+  u64 next = limit;
+  for (int level=0; level<TIMER_LEVELS; ++level) {
+    if (w->occupied[level] == 0) continue;
+    int shift = level * TIMER_SLOTS_BITS;
+    int curr = timer_slot_idx(w->now, level);
+    // rotate so that bit 0 is the slot after the current one
+    int rot = (curr + 1) & (TIMER_SLOTS - 1);
+    u64 bits = (w->occupied[level] >> rot) | (w->occupied[level] << ((TIMER_SLOTS - rot) & (TIMER_SLOTS - 1)));
+    u64 dist = __builtin_ctzll(bits) + 1;
+    u64 tick = ((w->now >> shift) + dist) << shift;
+    if (tick < next) next = tick;
+  }
+  return next;
+}
+
+/*
+  Advances the clock to now, calling fn for each expired timer, in tick order.
+  Ticks where no slot is cascaded or fired are skipped.
+  fn may schedule and cancel timers. Returns how many timers fired.
+*/
+isize timer_wheel_advance(TimerWheel* w, u64 now, TimerFn fn, void* ctx) {
+  isize fired = 0;
+  while (w->now < now) {
+    // nothing happens in between: skip the empty ticks
+    w->now = timer_next_event(w, now);
+
+    // cascade from the highest level whose slot just changed, so timers can fall down more than one level
+    int top = 0;
+    while (top + 1 < TIMER_LEVELS && (w->now & (((u64) 1 << ((top + 1) * TIMER_SLOTS_BITS)) - 1)) == 0) top += 1;
+    for (int level=top; level > 0; --level) timer_cascade(w, level);
+
+    isize* head = &w->slots[0][w->now & (TIMER_SLOTS - 1)];
+    while (*head >= 0) {
+      // one at a time, as fn may cancel other timers of this slot
+      isize i = *head;
+      TimerNode* n = &w->nodes[i];
+      *head = n->next;
+      if (*head >= 0) w->nodes[*head].prev = -1;
+      else w->occupied[0] &= ~((u64) 1 << (w->now & (TIMER_SLOTS - 1)));
+
+      TimerId id = ((u64) n->gen << 32) | (u64) i;
+      void* data = n->data;
+      timer_node_release(w, i);
+      fired += 1;
+      if (fn != NULL) fn(ctx, id, data);
+    }
+  }
+  return fired;
+}
+
+void timer_wheel_free(TimerWheel* w) {
+  allocator_free(w->alloc, w->nodes, sizeof(TimerNode) * w->nodes_cap);
+  w->nodes = NULL;
+  w->nodes_len = w->nodes_cap = w->len = 0;
+  w->free_head = -1;
+}
+
+#endif
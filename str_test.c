@@ -3,6 +3,20 @@
 
 #define res_dbg(s) printf("%d > " #s "\n", (int) (s));
 
+isize naive_match(str s, str target) {
+  for (isize i=0; i + target.len <= s.len; ++i) {
+    if (str_eq(str_slice(s, i, i + target.len), target)) return i;
+  }
+  return -1;
+}
+
+isize naive_match_ignorecase(str s, str target) {
+  for (isize i=0; i + target.len <= s.len; ++i) {
+    if (str_eq_ignorecase(str_slice(s, i, i + target.len), target)) return i;
+  }
+  return -1;
+}
+
 static const char const_cstr[] = "Hello Worldie!";
 static char static_cstr[] = "Hello Worldie!";
 
@@ -195,5 +209,171 @@ int main() {
   String_append_fmt(&fmt, " Overwriting the text with fmt... %s", fmt.data);
   str_dbg(fmt);
 
+  // compare the searchers against the naive search, on a tiny alphabet so that there are many partial matches
+  srand(42);
+  static char hay[4096], needle[64];
+  int mismatches = 0, found = 0;
+  for (int round=0; round<2000; ++round) {
+    isize hay_len = rand() % sizeof(hay);
+    isize needle_len = 1 + rand() % 40;
+    int alphabet = 2 + rand() % 3;
+    for (isize i=0; i<hay_len; ++i) hay[i] = 'a' + rand() % alphabet;
+    for (isize i=0; i<needle_len; ++i) needle[i] = 'a' + rand() % alphabet;
+    str h = str_from_cstr_unchecked(hay, hay_len);
+    str n = str_from_cstr_unchecked(needle, needle_len);
+
+    // sometimes plant the needle, at the end, where the SIMD loops hand over to the scalar tail
+    if (hay_len > needle_len && round % 3 == 0) memcpy(hay + hay_len - needle_len, needle, needle_len);
+    isize expected = naive_match(h, n);
+    if (str_match(h, n) != expected) mismatches += 1;
+    if (expected != -1) found += 1;
+  }
+  printf("Random searches: %d mismatches, %d found\n", mismatches, found);
+
+  // first and last bytes match everywhere: the search must fall back to Two-Way
+  memset(hay, 'a', sizeof(hay));
+  memset(needle, 'a', sizeof(needle));
+  needle[31] = 'b';
+  needle[63] = 'a';
+  res_dbg(str_match(str_from_cstr_unchecked(hay, sizeof(hay)), str_from_cstr_unchecked(needle, 63)));
+  hay[sizeof(hay) - 33] = 'b';
+  res_dbg(str_match(str_from_cstr_unchecked(hay, sizeof(hay)), str_from_cstr_unchecked(needle, 63)));
+  res_dbg(naive_match(str_from_cstr_unchecked(hay, sizeof(hay)), str_from_cstr_unchecked(needle, 63)));
+  res_dbg(str_match_all(str_from_cstr_unchecked(hay, 64), SV("aa")).len);
+
+  StrMatches matches = str_matches(SV("abababab"), SV("aba"));
+  while (str_has_match(&matches)) printf("%ld ", str_next_match(&matches));
+  printf("\n");
+
+  // searchers of every kind against the naive search: common bytes, rare bytes, and a mix of them
+  static const char alphabets[][4] = { "et ", "Q#e", "aZ\n" };
+  mismatches = found = 0;
+  int kinds[5] = {0};
+  for (int round=0; round<3000; ++round) {
+    const char* alphabet = alphabets[round % 3];
+    isize hay_len = rand() % sizeof(hay);
+    isize needle_len = rand() % 64;
+    for (isize i=0; i<hay_len; ++i) hay[i] = alphabet[rand() % 3];
+    for (isize i=0; i<needle_len; ++i) needle[i] = alphabet[rand() % 3];
+    if (hay_len > needle_len && round % 2 == 0) memcpy(hay + rand() % (hay_len - needle_len), needle, needle_len);
+    str h = str_from_cstr_unchecked(hay, hay_len);
+    StrSearcher searcher = str_searcher_new(str_from_cstr_unchecked(needle, needle_len));
+    kinds[searcher.kind] += 1;
+
+    StrSearcherMatches it = str_searcher_matches(h, &searcher);
+    isize offset = 0;
+    while (true) {
+      isize expected = offset > h.len ? -1 : naive_match(str_skip(h, offset), searcher.pattern);
+      if (expected != -1) expected += offset;
+      isize got = str_searcher_next_match(&it);
+      if (got != expected) mismatches += 1;
+      if (got == -1 || expected == -1) break;
+      found += 1;
+      offset = expected + 1;
+    }
+  }
+  printf("Searchers: %d mismatches, %d found, kinds %d %d %d %d %d\n", mismatches, found, kinds[0], kinds[1], kinds[2], kinds[3], kinds[4]);
+
+  // case insensitive, on mixed case alphabets, with letters next to '@' and '`' which only differ in bit 0x20 too
+  static const char case_alphabets[][5] = { "aAbB", "eE@`", "tT #" };
+  mismatches = found = 0;
+  for (int round=0; round<3000; ++round) {
+    const char* alphabet = case_alphabets[round % 3];
+    isize hay_len = rand() % sizeof(hay);
+    isize needle_len = rand() % 64;
+    for (isize i=0; i<hay_len; ++i) hay[i] = alphabet[rand() % 4];
+    for (isize i=0; i<needle_len; ++i) needle[i] = alphabet[rand() % 4];
+    // plant it with the case of its letters flipped
+    if (hay_len > needle_len && round % 2 == 0) {
+      isize at = rand() % (hay_len - needle_len);
+      for (isize i=0; i<needle_len; ++i) hay[at + i] = c_is_lower(needle[i]) ? c_to_upper(needle[i]) : c_to_lower(needle[i]);
+    }
+    str h = str_from_cstr_unchecked(hay, hay_len);
+    str n = str_from_cstr_unchecked(needle, needle_len);
+    StrSearcher searcher = str_searcher_new_ignorecase(n);
+
+    isize expected = naive_match_ignorecase(h, n);
+    if (str_match_ignorecase(h, n) != expected) mismatches += 1;
+    if (str_searcher_find(&searcher, h) != expected) mismatches += 1;
+    if (expected != -1) found += 1;
+  }
+  printf("Ignorecase searches: %d mismatches, %d found\n", mismatches, found);
+  res_dbg(str_match_ignorecase(SV("Disk FULL on /dev/sda"), SV("full on")));
+  res_dbg(str_match_ignorecase(SV("Disk FULL on /dev/sda"), SV("@")));
+
+  String cased = {0};
+  str_to_lower(&cased, SV("Hello WORLD, 123 @[`{ \xc3\x89T\xc3\x89"));
+  str_dbg(cased);
+  str_to_upper(&cased, SV("Hello WORLD, 123 @[`{ and a longer tail"));
+  str_dbg(cased);
+  String_to_lower(&cased);
+  str_dbg(cased);
+  String_free(&cased);
+
+  // numbered lines and the line index against str_lines, with lines of every length
+  static char text[1 << 16];
+  isize text_len = 0;
+  while (text_len < (isize) sizeof(text) - 200) {
+    isize line_len = rand() % 4 == 0 ? rand() % 150 : rand() % 8;
+    for (isize i=0; i<line_len; ++i) text[text_len++] = 'a' + rand() % 26;
+    if (rand() % 3 == 0) text[text_len++] = '\r';
+    text[text_len++] = '\n';
+  }
+  str t = str_from_cstr_unchecked(text, text_len - rand() % 2);
+  LineIndex li = line_index_new(t, true);
+  StrNumberedLines numbered = str_numbered_lines(t, true);
+  StrLines plain = str_lines(t);
+  mismatches = 0;
+  isize lines = 0;
+  while (str_has_line(&plain)) {
+    str expected = str_next_line(&plain);
+    bool ends_with_newline = expected.data + expected.len < t.data + t.len;
+    if (ends_with_newline && expected.len > 0 && expected.data[expected.len - 1] == '\r') expected.len -= 1;
+    if (!str_has_numbered_line(&numbered)) { mismatches += 1; break; }
+    StrLine line = str_next_numbered_line(&numbered);
+    isize offset = lines == 0 ? 0 : li.ends.data[lines - 1] + 1;
+    if (!str_eq(line.line, expected) || line.number != lines + 1 || line.offset != offset) mismatches += 1;
+    if (!str_eq(line_index_get(&li, lines), expected)) mismatches += 1;
+    if (line_index_line_of(&li, line.offset) != lines) mismatches += 1;
+    lines += 1;
+  }
+  if (str_has_numbered_line(&numbered) || line_index_len(&li) != lines) mismatches += 1;
+  printf("Lines: %d mismatches\n", mismatches);
+  line_index_free(&li);
+
+  StrNumberedLines crlf = str_numbered_lines(SV("first\r\nsecond\n\r\nfourth"), true);
+  while (str_has_numbered_line(&crlf)) {
+    StrLine line = str_next_numbered_line(&crlf);
+    printf("%ld@%ld: \"" str_fmt "\"\n", line.number, line.offset, str_arg(line.line));
+  }
+  OffsetList newlines = {0};
+  res_dbg(str_findc_all(SV("a\nbb\n\nccc\n"), '\n', &newlines));
+  res_dbg(newlines.data[3]);
+  OffsetList_free(&newlines);
+
+  // out smaller than a block still moves on
+  str dense = SV("x\nx\nx\nx\nx\nx\nx\nx\nx\nx\nx\nx\nx\nx\nx\nx\nx\nx\nx\nx\nx\nx\nx\nx\nx\nx\nx\nx\nx\nx\nx\nx\n");
+  isize small_out[3], small_from = 0, small_found = 0, small_calls = 0;
+  while (small_from < dense.len) {
+    small_found += str_findc_batch(dense, '\n', &small_from, small_out, 3);
+    small_calls += 1;
+  }
+  printf("Small batches: %ld newlines in %ld calls\n", small_found, small_calls);
+
+  StrSearcher log_searcher = str_searcher_new(SV("ERROR"));
+  str log = SV("INFO ok\nERROR disk full\nWARN slow\nERROR timeout\n");
+  StrSearcherMatches log_matches = str_searcher_matches(log, &log_searcher);
+  while (str_searcher_has_match(&log_matches)) printf("%ld ", str_searcher_next_match(&log_matches));
+  printf("\n");
+
+  SmallString small = SmallString_from_str(SV("tiny"));
+  SmallString_append_str(&small, SV(" string"));
+  printf("Inline: %d\n", SmallString_is_inline(&small));
+  str_dbg(SmallString_to_tmp_str(&small));
+  SmallString_append_str(&small, SV(", now grown past the inline buffer"));
+  printf("Inline: %d\n", SmallString_is_inline(&small));
+  str_dbg(SmallString_to_tmp_str(&small));
+  SmallString_free(&small);
+
   printf("Done\n");
 }
\ No newline at end of file
@@ -0,0 +1,75 @@
+#include <stdio.h>
+#include "stc_list.h"
+#include "stc_task.h"
+
+#define COUNT 10000000
+
+typedef struct {
+  i64* data;
+  _Atomic i64 sum;
+} SumJob;
+
+void fill_range(void* arg, isize begin, isize end) {
+  SumJob* job = arg;
+  for (isize i=begin; i<end; ++i) job->data[i] = i;
+}
+
+void sum_range(void* arg, isize begin, isize end) {
+  SumJob* job = arg;
+  i64 sum = 0;
+  for (isize i=begin; i<end; ++i) sum += job->data[i];
+  atomic_fetch_add(&job->sum, sum);
+}
+
+typedef struct {
+  int n;
+  i64 res;
+} FibJob;
+
+void fib_task(void* arg) {
+  FibJob* job = arg;
+  if (job->n < 20) {
+    i64 a = 0, b = 1;
+    for (int i=0; i<job->n; ++i) { i64 t = a + b; a = b; b = t; }
+    job->res = a;
+    return;
+  }
+
+  FibJob left = { job->n - 1, 0 };
+  FibJob right = { job->n - 2, 0 };
+  TaskGroup g = {0};
+  task_spawn(&g, fib_task, &left);
+  fib_task(&right);
+  task_sync(&g);
+  job->res = left.res + right.res;
+}
+
+int main() {
+  Scheduler s;
+  scheduler_init(&s, 4);
+  printf("Workers: %ld\n", s.workers_len);
+
+  SumJob job = { malloc(sizeof(i64) * COUNT), 0 };
+  parallel_for(0, COUNT, 4096, fill_range, &job);
+  parallel_for(0, COUNT, 4096, sum_range, &job);
+  printf("Parallel sum: %ld, expected %ld\n", atomic_load(&job.sum), (i64) COUNT * (COUNT - 1) / 2);
+  free(job.data);
+
+  FibJob fib = { 40, 0 };
+  fib_task(&fib);
+  printf("Fib(40): %ld, expected 102334155\n", fib.res);
+
+  // many small tasks, to grow the deques
+  static FibJob jobs[5000];
+  TaskGroup g = {0};
+  for (int i=0; i<5000; ++i) {
+    jobs[i] = (FibJob) { i % 20, 0 };
+    task_spawn(&g, fib_task, &jobs[i]);
+  }
+  task_sync(&g);
+  i64 total = 0;
+  for (int i=0; i<5000; ++i) total += jobs[i].res;
+  printf("Small tasks total: %ld\n", total);
+
+  scheduler_free(&s);
+}
@@ -0,0 +1,55 @@
+#include <stdio.h>
+#include "stc_rand.h"
+#include "stc_timer.h"
+
+#define COUNT 1000000
+#define MAX_DELAY 5000000
+
+typedef struct {
+  TimerWheel* w;
+  isize fired;
+  isize late;
+} Stats;
+
+void on_timer(void* ctx, TimerId id, void* data) {
+  UNUSED(id);
+  Stats* s = ctx;
+  u64 deadline = (uptr) data;
+  if (deadline != s->w->now) s->late += 1;
+  s->fired += 1;
+}
+
+int main() {
+  rand_seed(42);
+  TimerWheel w;
+  timer_wheel_init(&w, 1000, NULL);
+  Stats stats = { &w, 0, 0 };
+
+  static TimerId ids[COUNT];
+  for (isize i=0; i<COUNT; ++i) {
+    u64 deadline = w.now + 1 + rand_bounded(MAX_DELAY);
+    ids[i] = timer_schedule(&w, deadline, (void*) (uptr) deadline);
+  }
+
+  isize cancelled = 0;
+  for (isize i=0; i<COUNT; i += 3) cancelled += timer_cancel(&w, ids[i]);
+  printf("Scheduled: %d, cancelled: %ld, pending: %ld\n", COUNT, cancelled, w.len);
+  printf("Cancel twice: %d\n", timer_cancel(&w, ids[0]));
+
+  // advance in uneven steps
+  while (w.len > 0) timer_wheel_advance(&w, w.now + 1 + rand_bounded(1000), on_timer, &stats);
+  printf("Fired: %ld, late or early: %ld, now: %lu\n", stats.fired, stats.late, w.now);
+
+  // ids of fired timers are stale, even if the node is reused
+  TimerId reused = timer_schedule_after(&w, 10, (void*) (uptr) (w.now + 10));
+  printf("Old id pending: %d, new id pending: %d\n", timer_is_pending(&w, ids[1]), timer_is_pending(&w, reused));
+
+  // far away deadlines are parked in the top level, then cascaded down
+  u64 far = w.now + ((u64) 1 << (TIMER_SLOTS_BITS * TIMER_LEVELS)) + 12345;
+  timer_schedule(&w, far, (void*) (uptr) far);
+  stats = (Stats) { &w, 0, 0 };
+  timer_wheel_advance(&w, far, on_timer, &stats);
+  printf("Fired up to the far deadline: %ld, late or early: %ld\n", stats.fired, stats.late);
+
+  timer_wheel_free(&w);
+}